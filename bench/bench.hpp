@@ -0,0 +1,313 @@
+/**
+ * @file bench.hpp
+ * @brief FYSA120 mikrobenchmarkien apukirjasto
+ * @author keijo.k.a.salonen@student.jyu.fi
+ *
+ * Jokainen mittaus ajetaan ensin lämmittelynä, minkä jälkeen sisempien
+ * toistojen määrä kalibroidaan niin, että yksi näyte kestää vähintään
+ * tavoiteajan. Näytteistä raportoidaan mediaani, MAD, minimi, keskiarvo ja
+ * kvartiilit, jotka kestävät yksittäisiä häiriöitä paremmin kuin pelkkä
+ * keskiarvo.
+ *
+ * Tulokset kirjoitetaan JSON-tiedostoon (yksi mittaus riviä kohden), ja
+ * aiemmin talletettuun perustasoon (baseline) voi verrata valinnalla
+ * --baseline tiedosto.json.
+ *
+ * Benchmark-ohjelma sisällyttää mitattavan harjoitustyön lähdekoodin
+ * määrittelyllä FYSA120_NO_MAIN, jolloin sen main() jätetään pois.
+ *
+ * Käyttö benchmark-ohjelmassa:
+ *
+ *   fysa120::bench::kokoelma k("bench_kmc", argc, argv);
+ *   k.aja("queue.push", [&]{ ... });
+ *   k.aja("queue.pop", [&]{ q = taysi; }, [&]{ ... });   // valmistelu ei mukana ajassa
+ *   return k.valmis();
+ */
+#ifndef FYSA120_BENCH_HPP
+#define FYSA120_BENCH_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/**
+ * fysa120 nimiavaruus
+ */
+namespace fysa120
+{
+    /**
+     * Mikrobenchmarkit.
+     */
+    namespace bench
+    {
+        /**
+         * Estää kääntäjää poistamasta arvon laskentaa.
+         */
+        template<typename T>
+        inline void ala_optimoi(const T &v)
+        {
+            asm volatile("" : : "g"(&v) : "memory");
+        }
+
+
+        /**
+         * Yhden mittauksen tulos, ajat nanosekunteina yhtä toistoa kohden.
+         */
+        struct tulos
+        {
+            std::string nimi;
+            std::size_t naytteet;
+            std::size_t toistot;
+            double mediaani;
+            double mad;
+            double minimi;
+            double keskiarvo;
+            double q1;
+            double q3;
+        };
+
+
+        /**
+         * Kvantiili lajitellusta vektorista lineaarisella interpoloinnilla.
+         */
+        inline double kvantiili(const std::vector<double> &v, double q)
+        {
+            double i = q * (v.size() - 1);
+            std::size_t a = static_cast<std::size_t>(std::floor(i));
+            std::size_t b = std::min(a + 1, v.size() - 1);
+            return v[a] + (i - a) * (v[b] - v[a]);
+        }
+
+
+        /**
+         * Joukko mittauksia, jotka talletetaan samaan JSON-tiedostoon.
+         */
+        class kokoelma
+        {
+        public:
+            /**
+             * Lukee komentorivin valinnat:
+             *   --out tiedosto.json   tulosten tiedosto (oletus <nimi>.json)
+             *   --baseline tiedosto   vertailu aiempaan tulokseen
+             *   --samples N           näytteiden määrä (oletus 31)
+             *   --min-time S          yhden näytteen vähimmäiskesto sekunteina (oletus 0.01)
+             *   --filter teksti       ajetaan vain mittaukset, joiden nimessä on teksti
+             * Tuntematon valinta tai puuttuva arvo tulostaa käyttöohjeen ja
+             * lopettaa ohjelman.
+             */
+            kokoelma(const std::string &nimi, int argc, char *argv[])
+                : nimi_(nimi), ulos_(nimi + ".json"), naytteet_(31), min_aika_(0.01)
+            {
+                for(int i = 1 ; i < argc ; ++i)
+                {
+                    std::string s = argv[i];
+                    bool arvo = (i+1 < argc);
+                    if(s == "--out" && arvo)            ulos_ = argv[++i];
+                    else if(s == "--baseline" && arvo)  lue_perustaso(argv[++i]);
+                    else if(s == "--samples" && arvo)   naytteet_ = std::max(3, std::atoi(argv[++i]));
+                    else if(s == "--min-time" && arvo)  min_aika_ = std::atof(argv[++i]);
+                    else if(s == "--filter" && arvo)    suodatin_ = argv[++i];
+                    else
+                    {
+                        std::cerr << argv[0] << ": virheellinen valinta tai puuttuva arvo: " << s << "\n";
+                        kaytto(argv[0]);
+                        std::exit(1);
+                    }
+                }
+            }
+
+            /**
+             * Mittaa funktion f suoritusajan.
+             * @param nimi Mittauksen nimi
+             * @param f Mitattava funktio (yksi toisto)
+             */
+            void aja(const std::string &nimi, const std::function<void()> &f)
+            {
+                aja(nimi, std::function<void()>(), f);
+            }
+
+            /**
+             * Kuten aja(nimi, f), mutta valmistele() kutsutaan ennen jokaista
+             * toistoa mittauksen ulkopuolella, esim. kopioimaan syöte, jonka f
+             * kuluttaa. Toistot ajastetaan tällöin yksitellen, joten f:n tulee
+             * kestää selvästi kellon tarkkuutta pidempään.
+             * @param nimi Mittauksen nimi
+             * @param valmistele Mittaamaton valmistelu ennen jokaista toistoa
+             * @param f Mitattava funktio (yksi toisto)
+             */
+            void aja(const std::string &nimi, const std::function<void()> &valmistele,
+                     const std::function<void()> &f)
+            {
+                if(!suodatin_.empty() && nimi.find(suodatin_) == std::string::npos)
+                {
+                    return;
+                }
+                typedef std::chrono::steady_clock kello;
+
+                // toistojen kesto sekunteina
+                auto mittaa = [&](std::size_t toistot) {
+                    if(!valmistele)
+                    {
+                        auto t0 = kello::now();
+                        for(std::size_t i = 0 ; i < toistot ; ++i) f();
+                        return std::chrono::duration<double>(kello::now() - t0).count();
+                    }
+                    double s = 0.0;
+                    for(std::size_t i = 0 ; i < toistot ; ++i)
+                    {
+                        valmistele();
+                        auto t0 = kello::now();
+                        f();
+                        s += std::chrono::duration<double>(kello::now() - t0).count();
+                    }
+                    return s;
+                };
+
+                // lämmittely ja toistojen kalibrointi
+                std::size_t toistot = 1;
+                for(;;)
+                {
+                    double s = mittaa(toistot);
+                    if(s >= min_aika_ || toistot >= (std::size_t(1) << 30))
+                    {
+                        break;
+                    }
+                    toistot *= (s > 0.0) ? std::max<std::size_t>(2, static_cast<std::size_t>(1.2*min_aika_/s)) : 10;
+                }
+
+                std::vector<double> t(naytteet_);
+                for(std::size_t n = 0 ; n < t.size() ; ++n)
+                {
+                    t[n] = 1.0e9 * mittaa(toistot) / toistot;
+                }
+                std::sort(t.begin(), t.end());
+
+                tulos r;
+                r.nimi = nimi;
+                r.naytteet = t.size();
+                r.toistot = toistot;
+                r.mediaani = kvantiili(t, 0.5);
+                r.minimi = t.front();
+                r.q1 = kvantiili(t, 0.25);
+                r.q3 = kvantiili(t, 0.75);
+                double summa = 0.0;
+                std::vector<double> poikkeamat(t.size());
+                for(std::size_t i = 0 ; i < t.size() ; ++i)
+                {
+                    summa += t[i];
+                    poikkeamat[i] = std::abs(t[i] - r.mediaani);
+                }
+                std::sort(poikkeamat.begin(), poikkeamat.end());
+                r.keskiarvo = summa / t.size();
+                r.mad = kvantiili(poikkeamat, 0.5);
+                tulokset_.push_back(r);
+                tulosta(r);
+            }
+
+            /**
+             * Kirjoittaa tulokset JSON-tiedostoon.
+             * @return ohjelman paluuarvo
+             */
+            int valmis(void) const
+            {
+                std::ofstream out(ulos_);
+                out.precision(6);
+                out << "{\n  \"suite\": \"" << nimi_ << "\",\n  \"unit\": \"ns\",\n  \"benchmarks\": {";
+                const char *erotin = "\n";
+                for(const auto &r : tulokset_)
+                {
+                    out << erotin << "    \"" << r.nimi << "\": {\"median_ns\": " << r.mediaani
+                        << ", \"mad_ns\": " << r.mad << ", \"min_ns\": " << r.minimi
+                        << ", \"mean_ns\": " << r.keskiarvo << ", \"q1_ns\": " << r.q1
+                        << ", \"q3_ns\": " << r.q3 << ", \"samples\": " << r.naytteet
+                        << ", \"iterations\": " << r.toistot << "}";
+                    erotin = ",\n";
+                }
+                out << "\n  }\n}\n";
+                return out.good() ? 0 : 1;
+            }
+
+        private:
+            /**
+             * Tulostaa käyttöohjeen.
+             */
+            static void kaytto(const char *ohjelma)
+            {
+                std::cerr << "Käyttö: " << ohjelma << " [valinnat]\n"
+                          << "  --out tiedosto.json   tulosten tiedosto\n"
+                          << "  --baseline tiedosto   vertailu aiempaan tulokseen\n"
+                          << "  --samples N           näytteiden määrä (oletus 31)\n"
+                          << "  --min-time S          yhden näytteen vähimmäiskesto sekunteina (oletus 0.01)\n"
+                          << "  --filter teksti       ajetaan vain mittaukset, joiden nimessä on teksti\n";
+            }
+
+            /**
+             * Perustason mediaani ja MAD.
+             */
+            struct perustaso
+            {
+                double mediaani;
+                double mad;
+            };
+
+            void tulosta(const tulos &r) const
+            {
+                std::cout << nimi_ << "/" << r.nimi << ": mediaani " << r.mediaani << " ns"
+                          << " (MAD " << r.mad << ", min " << r.minimi << ", n=" << r.naytteet
+                          << "x" << r.toistot << ")";
+                auto p = perustaso_.find(r.nimi);
+                if(p != perustaso_.end() && p->second.mediaani > 0.0)
+                {
+                    double suhde = r.mediaani / p->second.mediaani;
+                    // muutos on merkittävä, jos se ylittää kolme kertaa molempien
+                    // ajojen MAD:ien summan
+                    bool merkittava = std::abs(r.mediaani - p->second.mediaani) > 3.0 * (r.mad + p->second.mad);
+                    std::cout << "  perustaso " << p->second.mediaani << " ns, suhde " << suhde
+                              << (merkittava ? (suhde > 1.0 ? "  HIDASTUNUT" : "  NOPEUTUNUT") : "");
+                }
+                std::cout << std::endl;
+            }
+
+            /**
+             * Lukee perustason mediaanit ja MAD:t valmis():n kirjoittamasta tiedostosta.
+             */
+            void lue_perustaso(const std::string &tiedosto)
+            {
+                std::ifstream in(tiedosto);
+                std::string rivi;
+                while(std::getline(in, rivi))
+                {
+                    std::size_t a = rivi.find('"');
+                    std::size_t b = rivi.find('"', a + 1);
+                    std::size_t m = rivi.find("\"median_ns\":");
+                    if(a == std::string::npos || b == std::string::npos || m == std::string::npos)
+                    {
+                        continue;
+                    }
+                    std::size_t d = rivi.find("\"mad_ns\":");
+                    perustaso &p = perustaso_[rivi.substr(a + 1, b - a - 1)];
+                    p.mediaani = std::atof(rivi.c_str() + m + 12);
+                    p.mad = (d == std::string::npos) ? 0.0 : std::atof(rivi.c_str() + d + 9);
+                }
+            }
+
+            std::string nimi_;
+            std::string ulos_;
+            std::string suodatin_;
+            int naytteet_;
+            double min_aika_;
+            std::vector<tulos> tulokset_;
+            std::map<std::string, perustaso> perustaso_;
+        };
+    }
+}
+
+#endif
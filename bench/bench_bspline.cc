@@ -0,0 +1,219 @@
+/**
+ * @file bench_bspline.cc
+ * @brief Mikrobenchmarkit: exercise5.cc B-spline kantafunktiot ja sovitus
+ */
+#define FYSA120_NO_MAIN
+#include "../exercise5.cc"
+#include "bench.hpp"
+#include <random>
+#include <algorithm>
+
+int main(int argc, char *argv[])
+{
+    fysa120::bench::kokoelma k("bench_bspline", argc, argv);
+    std::vector<double> t{0,1,2,3,4,4,4,5,6,7,8,9,10};
+    my::Bspline<decltype(t)> bs(t);
+
+    const int N = 1000;
+    arma::vec x(N);
+    arma::vec y(N);
+    for(int i = 0 ; i < N ; ++i)
+    {
+        x[i] = i*10.0/(N-1);
+        y[i] = 3*std::exp(-std::abs(x[i]-4));
+    }
+
+    k.aja("Bspline::B.single", [&]{
+        double s = bs.B(4, 4.37);
+        fysa120::bench::ala_optimoi(s);
+    });
+
+    arma::mat A(N, bs.max_i());
+    k.aja("design_matrix.dense.1000", [&]{
+        for(int j = 0 ; j < N ; ++j)
+        {
+            for(int i = 0 ; i < bs.max_i() ; ++i)
+            {
+                A(j,i) = bs.B(i,x[j]);
+            }
+        }
+        fysa120::bench::ala_optimoi(A(0,0));
+    });
+    k.aja("solve.dense.1000", [&]{
+        arma::vec c = solve(A,y);
+        fysa120::bench::ala_optimoi(c[0]);
+    });
+
+    fysa120::bspline_kanta kanta(t, static_cast<int>(t.size()) - 1 - bs.max_i());
+    k.aja("bspline_kanta::arvot.single", [&]{
+        double Nx[fysa120::bspline_kanta::max_aste + 1];
+        int i0 = kanta.arvot(4.37, Nx);
+        fysa120::bench::ala_optimoi(i0);
+        fysa120::bench::ala_optimoi(Nx[0]);
+    });
+    k.aja("design_matrix.sparse.1000", [&]{
+        arma::sp_mat S = fysa120::suunnittelumatriisi(kanta, x.memptr(), x.n_elem).harva();
+        fysa120::bench::ala_optimoi(S);
+    });
+
+    std::vector<double> xs(1000000);
+    for(std::size_t i = 0 ; i < xs.size() ; ++i)
+    {
+        xs[i] = i*10.0/(xs.size()-1);
+    }
+    k.aja("design_matrix.banded.1M", [&]{
+        fysa120::kaistamatriisi K = fysa120::suunnittelumatriisi(kanta, xs.data(), xs.size());
+        fysa120::bench::ala_optimoi(K.arvot[0]);
+    });
+
+    k.aja("solve.banded_qr.1000", [&]{
+        std::vector<double> c;
+        double kunto;
+        fysa120::sovita_kaista(kanta, x.memptr(), y.memptr(), x.n_elem, c, kunto);
+        fysa120::bench::ala_optimoi(c[0]);
+    });
+    std::vector<double> ys(xs.size());
+    for(std::size_t i = 0 ; i < xs.size() ; ++i)
+    {
+        ys[i] = 3*std::exp(-std::abs(xs[i]-4));
+    }
+    k.aja("solve.banded_qr.1M", [&]{
+        std::vector<double> c;
+        double kunto;
+        fysa120::sovita_kaista(kanta, xs.data(), ys.data(), xs.size(), c, kunto);
+        fysa120::bench::ala_optimoi(c[0]);
+    });
+    std::vector<double> kertoimet(kanta.maara(), 1.0);
+    fysa120::bspline_kayra kayra(kanta, kertoimet);
+    arma::mat B(N, bs.max_i());
+    arma::vec c(kertoimet);
+    k.aja("evaluate.matrix.1000", [&]{
+        for(int j = 0 ; j < N ; ++j)
+        {
+            for(int i = 0 ; i < bs.max_i() ; ++i)
+            {
+                B(j,i) = bs.B(i,x[j]);
+            }
+        }
+        arma::vec Y = B * c;
+        fysa120::bench::ala_optimoi(Y[0]);
+    });
+    std::vector<double> X(10000000);
+    std::vector<double> Y(X.size());
+    for(std::size_t i = 0 ; i < X.size() ; ++i)
+    {
+        X[i] = i*10.0/(X.size()-1);
+    }
+    k.aja("evaluate.de_boor.1000", [&]{
+        kayra.arvioi(x.memptr(), Y.data(), x.n_elem, 1);
+        fysa120::bench::ala_optimoi(Y[0]);
+    });
+    k.aja("evaluate.de_boor.sorted.10M.1thread", [&]{
+        kayra.arvioi(X.data(), Y.data(), X.size(), 1);
+        fysa120::bench::ala_optimoi(Y[0]);
+    });
+    k.aja("evaluate.de_boor.sorted.10M.threads", [&]{
+        kayra.arvioi(X.data(), Y.data(), X.size());
+        fysa120::bench::ala_optimoi(Y[0]);
+    });
+    std::vector<double> Xs(xs);
+    std::shuffle(Xs.begin(), Xs.end(), std::mt19937(1));
+    k.aja("evaluate.de_boor.unsorted.1M.1thread", [&]{
+        kayra.arvioi(Xs.data(), Y.data(), Xs.size(), 1);
+        fysa120::bench::ala_optimoi(Y[0]);
+    });
+    // inkrementaalinen päivitys verrattuna koko sovituksen toistamiseen
+    std::vector<double> x10k(10000);
+    std::vector<double> y10k(x10k.size());
+    for(std::size_t i = 0 ; i < x10k.size() ; ++i)
+    {
+        x10k[i] = i*10.0/(x10k.size()-1);
+        y10k[i] = 3*std::exp(-std::abs(x10k[i]-4));
+    }
+    // näytteet kasvavassa x:ssä tuoreeseen virtaan (O(p^2) päivitys), joten
+    // näytettä kohden aika on mittaus / 10k
+    fysa120::bspline_virta virta(kanta, 0.999);
+    k.aja("stream.sample.10k", [&]{ virta = fysa120::bspline_virta(kanta, 0.999); }, [&]{
+        for(std::size_t i = 0 ; i < x10k.size() ; ++i)
+        {
+            virta.lisaa(x10k[i], y10k[i]);
+        }
+        fysa120::bench::ala_optimoi(virta);
+    });
+    k.aja("stream.sample+coefficients.10k", [&]{ virta = fysa120::bspline_virta(kanta, 0.999); }, [&]{
+        std::vector<double> c;
+        double kunto;
+        for(std::size_t i = 0 ; i < x10k.size() ; ++i)
+        {
+            virta.lisaa(x10k[i], y10k[i]);
+            virta.kertoimet(c, kunto);
+        }
+        fysa120::bench::ala_optimoi(c[0]);
+    });
+    k.aja("refit.banded_qr.10k", [&]{
+        std::vector<double> c;
+        double kunto;
+        fysa120::sovita_kaista(kanta, x10k.data(), y10k.data(), x10k.size(), c, kunto);
+        fysa120::bench::ala_optimoi(c[0]);
+    });
+    // tasoitus: yksi lambda ja koko GCV-haku
+    std::vector<double> tt(47);
+    for(int i = 0 ; i < 47 ; ++i)
+    {
+        tt[i] = 10.0*std::min(std::max(i - 3, 0), 40)/40;
+    }
+    fysa120::bspline_kanta tasainen(tt, 3);
+    fysa120::bspline_tasoitus tasoitus(tasainen, x10k.data(), y10k.data(), x10k.size());
+    k.aja("smoothing.lambda.10k", [&]{
+        std::vector<double> c;
+        double jalki;
+        double jaannos;
+        tasoitus.sovita(tasoitus.mittakaava(), c, jalki, jaannos);
+        fysa120::bench::ala_optimoi(jalki);
+    });
+    k.aja("smoothing.gcv_select.10k", [&]{
+        std::vector<double> c;
+        double lambda;
+        double jalki;
+        double arvo;
+        tasoitus.valitse(lambda, c, jalki, arvo);
+        fysa120::bench::ala_optimoi(lambda);
+    });
+    // tensoritulopinta 1000 x 1000 hilaan
+    const std::size_t G = 1000;
+    std::vector<double> g(G);
+    std::vector<double> zg(G*G);
+    for(std::size_t i = 0 ; i < G ; ++i)
+    {
+        g[i] = i*10.0/(G-1);
+    }
+    for(std::size_t i = 0 ; i < G*G ; ++i)
+    {
+        zg[i] = 3*std::exp(-std::abs(g[i / G]-4))*std::cos(0.5*g[i % G]);
+    }
+    std::vector<double> C;
+    k.aja("surface.fit.1000x1000.1thread", [&]{
+        double kunto;
+        fysa120::sovita_pinta(kanta, kanta, g.data(), G, g.data(), G, zg.data(), C, kunto, 1);
+        fysa120::bench::ala_optimoi(C[0]);
+    });
+    k.aja("surface.fit.1000x1000.threads", [&]{
+        double kunto;
+        fysa120::sovita_pinta(kanta, kanta, g.data(), G, g.data(), G, zg.data(), C, kunto);
+        fysa120::bench::ala_optimoi(C[0]);
+    });
+    // sovitetaan kerran mittausten ulkopuolella, jotta --filter voi ohittaa sovituksen
+    double kunto;
+    fysa120::sovita_pinta(kanta, kanta, g.data(), G, g.data(), G, zg.data(), C, kunto);
+    fysa120::bspline_pinta pinta(kanta, kanta, C);
+    std::vector<double> sg(G*G);
+    k.aja("surface.evaluate.1000x1000.1thread", [&]{
+        pinta.arvioi_hila(g.data(), G, g.data(), G, sg.data(), 1);
+        fysa120::bench::ala_optimoi(sg[0]);
+    });
+    k.aja("surface.evaluate.1000x1000.threads", [&]{
+        pinta.arvioi_hila(g.data(), G, g.data(), G, sg.data());
+        fysa120::bench::ala_optimoi(sg[0]);
+    });
+    return k.valmis();
+}
@@ -0,0 +1,45 @@
+/**
+ * @file bench_findroot.cc
+ * @brief Mikrobenchmarkit: exercise1_2.cc findroot
+ */
+#define FYSA120_NO_MAIN
+#include "../exercise1_2.cc"
+#include "bench.hpp"
+
+int main(int argc, char *argv[])
+{
+    fysa120::bench::kokoelma k("bench_findroot", argc, argv);
+    double x = 0.0;
+    k.aja("findroot.bisection", [&]{
+        fysa120::findroot(fysa120::f, 2.5, 4.0, 0.00001, x);
+        fysa120::bench::ala_optimoi(x);
+    });
+    k.aja("findroot.newton", [&]{
+        fysa120::findroot(fysa120::f, fysa120::fder, 2.5, 4.0, 0.00001, x);
+        fysa120::bench::ala_optimoi(x);
+    });
+    // parametrin theta = 0 ... 2 pyyhkäisy: kylmät ratkaisut vs. jatkaminen
+    const int askeleet = 1000;
+    k.aja("sweep.newton_cold.1000", [&]{
+        for(int i = 1 ; i <= askeleet ; ++i)
+        {
+            const double theta = 2.0 * i / askeleet;
+            fysa120::findroot([theta](double x) { return fysa120::f(x) - theta; }, fysa120::fder, 2.5, 4.0, 0.00001, x);
+        }
+        fysa120::bench::ala_optimoi(x);
+    });
+    k.aja("sweep.continuation.1000", [&]{
+        fysa120::juurten_jatkaja jatkaja(
+            [](double x, double theta) { return fysa120::f(x) - theta; },
+            [](double x, double) { return fysa120::fder(x); },
+            [](double, double) { return -1.0; },
+            0.00001, 1.0e-10, 2.0 / askeleet);
+        jatkaja.lisaa_haara(M_PI, 0.0);
+        for(int i = 1 ; i <= askeleet ; ++i)
+        {
+            jatkaja.siirra(2.0 * i / askeleet);
+        }
+        fysa120::bench::ala_optimoi(jatkaja.haarat()[0].x);
+    });
+    return k.valmis();
+}
@@ -0,0 +1,50 @@
+/**
+ * @file bench_kmc.cc
+ * @brief Mikrobenchmarkit: exercise2.cc tapahtumajono
+ */
+#define FYSA120_NO_MAIN
+#include "../exercise2.cc"
+#include "bench.hpp"
+
+int main(int argc, char *argv[])
+{
+    fysa120::bench::kokoelma k("bench_kmc", argc, argv);
+    const std::size_t n = 100000;
+
+    std::vector<fysa120::event> events;
+    events.reserve(n);
+    k.aja("generate_events.100k", [&]{
+        events.clear();
+        fysa120::generate_events(events, n);
+        fysa120::bench::ala_optimoi(events.back());
+    });
+
+    k.aja("queue.push.100k", [&]{
+        std::priority_queue<fysa120::event> q;
+        fysa120::insert_events_priority_queue(q, events);
+        fysa120::bench::ala_optimoi(q.top());
+    });
+
+    std::priority_queue<fysa120::event> taysi;
+    fysa120::insert_events_priority_queue(taysi, events);
+    // jonon kopiointi tehdään valmistelussa, joten mitataan vain poistot
+    std::priority_queue<fysa120::event> q;
+    k.aja("queue.pop.100k", [&]{ q = taysi; }, [&]{
+        double s = 0.0;
+        while(!q.empty())
+        {
+            s += q.top().execution_time;
+            q.pop();
+        }
+        fysa120::bench::ala_optimoi(s);
+    });
+    k.aja("run_simulation.observers.100k", [&]{ q = taysi; }, [&]{
+        fysa120::momentti_havainnoija m;
+        fysa120::prosessilaskuri p;
+        fysa120::odotushistogrammi o(50.0, 100);
+        fysa120::lapaisy l(0.0, 100.0, 100);
+        fysa120::run_simulation(q, {&m, &p, &o, &l});
+        fysa120::bench::ala_optimoi(m.odotus().ka);
+    });
+    return k.valmis();
+}
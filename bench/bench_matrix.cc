@@ -0,0 +1,57 @@
+/**
+ * @file bench_matrix.cc
+ * @brief Mikrobenchmarkit: project.cc matriisin kokoaminen
+ */
+#define FYSA120_NO_MAIN
+#include "../project.cc"
+#include "bench.hpp"
+
+int main(int argc, char *argv[])
+{
+    fysa120::bench::kokoelma k("bench_matrix", argc, argv);
+    k.aja("integroi_f1", [&]{
+        std::complex<double> z = fysa120::integroi_f1(3.0, 1.0);
+        fysa120::bench::ala_optimoi(z);
+    });
+    k.aja("integroi_f2", [&]{
+        std::complex<double> z = fysa120::integroi_f2(2.0, 2.0);
+        fysa120::bench::ala_optimoi(z);
+    });
+    for(arma::uword N : {5, 20, 50})
+    {
+        k.aja("muodosta_matriisi." + std::to_string(N), [&]{
+            arma::cx_mat A = fysa120::muodosta_matriisi(N);
+            fysa120::bench::ala_optimoi(A(0,0));
+        });
+    }
+    for(arma::uword N : {50, 200})
+    {
+        k.aja("muodosta_matriisi.cheb." + std::to_string(N), [&]{
+            fysa120::chebyshev_tilastot t;
+            arma::cx_mat A = fysa120::muodosta_matriisi_cheb(N, 1.0e-8, t);
+            fysa120::bench::ala_optimoi(A(0,0));
+        });
+    }
+    k.aja("muodosta_matriisi.200", [&]{
+        arma::cx_mat A = fysa120::muodosta_matriisi(200);
+        fysa120::bench::ala_optimoi(A(0,0));
+    });
+    // kokoamisen oma kustannus ilman integrointia: suljettu muoto kummallekin
+    auto f1 = [](double l, double k) { return fysa120::f1_suljettu(l,k).real(); };
+    for(arma::uword N : {1000, 4000})
+    {
+        k.aja("chebyshev_kokoa.closed_form." + std::to_string(N), [&]{
+            arma::cx_mat A(N, N);
+            fysa120::chebyshev_tilastot t;
+            fysa120::chebyshev_kokoa(N, N, f1, [&A](std::size_t l, std::size_t k0, const double *z, std::size_t n) {
+                for(std::size_t i = 0 ; i < n ; ++i) A(k0 + i, l) = z[i];
+            }, 1.0e-10, 16, t);
+            fysa120::bench::ala_optimoi(A(0,0));
+        });
+        k.aja("muodosta_matriisi.closed_form." + std::to_string(N), [&]{
+            arma::cx_mat A = fysa120::muodosta_matriisi(N, fysa120::f1_suljettu);
+            fysa120::bench::ala_optimoi(A(0,0));
+        });
+    }
+    return k.valmis();
+}
@@ -0,0 +1,31 @@
+/**
+ * @file bench_ode.cc
+ * @brief Mikrobenchmarkit: exercise3.cc odeint askeleet
+ */
+#define FYSA120_NO_MAIN
+#include "../exercise3.cc"
+#include "bench.hpp"
+
+int main(int argc, char *argv[])
+{
+    fysa120::bench::kokoelma k("bench_ode", argc, argv);
+    namespace odeint = boost::numeric::odeint;
+    typedef fysa120::state_type state_type;
+
+    odeint::runge_kutta4<state_type> rk4;
+    k.aja("odeint.rk4.do_step", [&]{
+        state_type x = {{2.0, 5.0/2.0}};
+        rk4.do_step(fysa120::ratkaistava_dy, x, 0.0, 0.01);
+        fysa120::bench::ala_optimoi(x);
+    });
+
+    typedef odeint::runge_kutta_cash_karp54<state_type> stepper_type;
+    auto stepper = odeint::make_controlled<stepper_type>(1.0e-10, 1.0e-6);
+    k.aja("odeint.cash_karp54.try_step", [&]{
+        state_type x = {{2.0, 5.0/2.0}};
+        double t = 0.0, dt = 0.01;
+        stepper.try_step(fysa120::ratkaistava_dy, x, t, dt);
+        fysa120::bench::ala_optimoi(x);
+    });
+    return k.valmis();
+}
@@ -0,0 +1,92 @@
+/**
+ * @file bench_pdes.cc
+ * @brief Mikrobenchmarkit: exercise2.cc rinnakkainen simulaatio, skaalautuvuus 1-64 säikeellä
+ *
+ * Säikeiden määrästä riippuvat tulokset kuvaavat vain sitä konetta, jolla ne
+ * on ajettu; ohjelma tulostaa aluksi laitteiston säikeiden määrän. Yhden
+ * ytimen koneella säikeet vuorottelevat, jolloin luvut mittaavat lähinnä
+ * synkronoinnin kustannusta eivätkä skaalautumista.
+ */
+#define FYSA120_NO_MAIN
+#include "../exercise2.cc"
+#include "bench.hpp"
+
+/**
+ * LP-kohtaiset havainnoijat, jotka yhdistetään ajon lopuksi.
+ */
+struct havainnoijat
+{
+    fysa120::momentti_havainnoija m;
+    fysa120::prosessilaskuri p;
+    fysa120::odotushistogrammi o{50.0, 100};
+    fysa120::lapaisy l{0.0, 100.0, 100};
+};
+
+int main(int argc, char *argv[])
+{
+    std::cout << "# laitteiston säikeet: " << std::thread::hardware_concurrency() << std::endl;
+    fysa120::bench::kokoelma k("bench_pdes", argc, argv);
+    const std::size_t n = 1000000;
+    std::vector<fysa120::event> events;
+    events.reserve(n);
+    fysa120::generate_events(events, n, 1024);
+
+    k.aja("sequential.1M", [&]{
+        std::priority_queue<fysa120::event> q(events.begin(), events.end());
+        havainnoijat h;
+        fysa120::run_simulation(q, {&h.m, &h.p, &h.o, &h.l});
+        fysa120::bench::ala_optimoi(h.m.odotus().ka);
+    });
+
+    // ennakkoikkunat (oletus 1 aikayksikkö ja kapeampi 0.1), ikkunat ja
+    // suoritusjärjestyksen lomitus momentti_havainnoijalle, sekä vertailuna
+    // yksi ikkuna ilman synkronointia
+    struct tapaus
+    {
+        const char *nimi;
+        double ennakko;
+        bool jarjestetty;
+    };
+    const tapaus tapaukset[] = {
+        {"pdes.window1.1M.lp", 1.0, false},
+        {"pdes.window0.1.1M.lp", 0.1, false},
+        {"pdes.window1.ordered.1M.lp", 1.0, true},
+        {"pdes.nosync.1M.lp", std::numeric_limits<double>::infinity(), false},
+    };
+    for(const tapaus &t : tapaukset)
+    {
+        for(std::size_t lpt : {1, 2, 4, 8, 16, 32, 64})
+        {
+            k.aja(t.nimi + std::to_string(lpt), [&]{
+                fysa120::rinnakkainen_simulaatio sim(lpt);
+                sim.lisaa(events);
+                std::vector<havainnoijat> h(lpt);
+                std::vector<std::vector<fysa120::havainnoija*>> hp(lpt);
+                fysa120::momentti_havainnoija m;
+                for(std::size_t i = 0 ; i < lpt ; ++i)
+                {
+                    hp[i] = {&h[i].p, &h[i].o, &h[i].l};
+                    if(!t.jarjestetty)
+                    {
+                        hp[i].push_back(&h[i].m);
+                    }
+                }
+                std::vector<fysa120::havainnoija*> jarjestetyt;
+                if(t.jarjestetty)
+                {
+                    jarjestetyt.push_back(&m);
+                }
+                sim.aja(hp, jarjestetyt, fysa120::rinnakkainen_simulaatio::kasittelija_t(), t.ennakko);
+                for(std::size_t i = 1 ; i < lpt ; ++i)
+                {
+                    h[0].m.yhdista(h[i].m);
+                    h[0].p.yhdista_osa(h[i].p);
+                    h[0].o.yhdista(h[i].o);
+                    h[0].l.yhdista(h[i].l);
+                }
+                fysa120::bench::ala_optimoi(t.jarjestetty ? m.vali().ka : h[0].m.odotus().ka);
+            });
+        }
+    }
+    return k.valmis();
+}
@@ -0,0 +1,36 @@
+/**
+ * @file bench_qags.cc
+ * @brief Mikrobenchmarkit: exercise4.cc gsl_integration_qags
+ */
+#define FYSA120_NO_MAIN
+#include "../exercise4.cc"
+#include "bench.hpp"
+
+int main(int argc, char *argv[])
+{
+    fysa120::bench::kokoelma k("bench_qags", argc, argv);
+    gsl_integration_workspace *work_ptr = gsl_integration_workspace_alloc(LIMIT_SIZE);
+    fysa120::parametrit p;
+    p.alfa = 5.6;
+    p.beeta = 2.2;
+    gsl_function funktio;
+    funktio.function = &fysa120::f;
+    funktio.params = &p;
+
+    k.aja("gsl_integration_qags", [&]{
+        double vastaus, virhe;
+        gsl_integration_qags(&funktio, 0.0, fysa120::pi/4.0, 1.0e-8, 1.0e-8,
+                             LIMIT_SIZE, work_ptr, &vastaus, &virhe);
+        fysa120::bench::ala_optimoi(vastaus);
+    });
+    k.aja("gsl_integration_qags+alloc", [&]{
+        gsl_integration_workspace *w = gsl_integration_workspace_alloc(LIMIT_SIZE);
+        double vastaus, virhe;
+        gsl_integration_qags(&funktio, 0.0, fysa120::pi/4.0, 1.0e-8, 1.0e-8,
+                             LIMIT_SIZE, w, &vastaus, &virhe);
+        gsl_integration_workspace_free(w);
+        fysa120::bench::ala_optimoi(vastaus);
+    });
+    gsl_integration_workspace_free(work_ptr);
+    return k.valmis();
+}
@@ -0,0 +1,578 @@
+/**
+ * @file binary_io.hpp
+ * @brief FYSA120 binäärinen tulostiedostomuoto
+ * @author keijo.k.a.salonen@student.jyu.fi
+ *
+ * Yhteinen binäärimuoto matriiseille ja tuloksille. Tiedosto koostuu
+ * 128 tavun otsakkeesta ja sen perään tulevasta raakadatasta:
+ *
+ *   0   char[8]   tunniste "FYSA120B"
+ *   8   uint32    versio
+ *   12  uint32    tietotyyppi (dtype)
+ *   16  uint32    ulottuvuuksien määrä (1-4)
+ *   20  uint32    järjestys: 0 = sarakkeittain (armadillo), 1 = riveittäin
+ *   24  uint64[4] muoto
+ *   56  uint64    datan koko tavuina
+ *   64  uint64    datan tarkiste
+ *   72  ...       varattu (nollia)
+ *   128 data
+ *
+ * Data alkaa 128 tavun kohdalta, joten mmap:lla luettuun dataan voi viitata
+ * suoraan ilman kopiointia. Tavujärjestys on koneen oma (little-endian).
+ *
+ * Tekstimuunnokset tukevat sarakemuotoisia taulukoita (xy_data.dat,
+ * fit_data.dat) ja armadillon arma_ascii -muotoa (A.mat).
+ */
+#ifndef FYSA120_BINARY_IO_HPP
+#define FYSA120_BINARY_IO_HPP
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <complex>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <initializer_list>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/**
+ * fysa120 nimiavaruus
+ */
+namespace fysa120
+{
+    /**
+     * Tuetut tietotyypit.
+     */
+    enum class dtype : std::uint32_t
+    {
+        f64 = 1,
+        c128 = 2,
+        f32 = 3,
+        i32 = 4,
+        i64 = 5,
+        u64 = 6
+    };
+
+
+    /**
+     * Tietotyypin alkion koko tavuina.
+     */
+    inline std::size_t dtype_koko(dtype t)
+    {
+        switch(t)
+        {
+            case dtype::f64:  return 8;
+            case dtype::c128: return 16;
+            case dtype::f32:  return 4;
+            case dtype::i32:  return 4;
+            case dtype::i64:  return 8;
+            case dtype::u64:  return 8;
+        }
+        return 0;
+    }
+
+
+    /**
+     * C++ tyypin ja dtype:n vastaavuus.
+     */
+    template<typename T> struct dtype_of;
+    template<> struct dtype_of<double>               { static constexpr dtype arvo = dtype::f64; };
+    template<> struct dtype_of<std::complex<double>> { static constexpr dtype arvo = dtype::c128; };
+    template<> struct dtype_of<float>                { static constexpr dtype arvo = dtype::f32; };
+    template<> struct dtype_of<std::int32_t>         { static constexpr dtype arvo = dtype::i32; };
+    template<> struct dtype_of<std::int64_t>         { static constexpr dtype arvo = dtype::i64; };
+    template<> struct dtype_of<std::uint64_t>        { static constexpr dtype arvo = dtype::u64; };
+
+
+    /**
+     * Tiedoston otsake, ks. tiedoston kuvaus.
+     */
+    struct binaari_otsake
+    {
+        char tunniste[8];
+        std::uint32_t versio;
+        std::uint32_t tyyppi;
+        std::uint32_t ndim;
+        std::uint32_t jarjestys;
+        std::uint64_t muoto[4];
+        std::uint64_t tavut;
+        std::uint64_t tarkiste;
+        std::uint8_t varattu[56];
+    };
+    static_assert(sizeof(binaari_otsake) == 128, "otsakkeen koko on 128 tavua");
+
+    const char binaari_tunniste[8] = {'F','Y','S','A','1','2','0','B'};
+    const std::uint32_t binaari_versio = 1;
+
+
+    /**
+     * 64-bittinen tarkiste, joka voidaan laskea paloittain.
+     *
+     * Data käsitellään 32 tavun lohkoina neljällä rinnakkaisella
+     * FNV-tyyppisellä kaistalla, jotta laskenta pysyy levyn nopeuden tasalla.
+     */
+    class tarkiste64
+    {
+    public:
+        tarkiste64() : n_(0), puskuri_n_(0)
+        {
+            for(int i = 0 ; i < 4 ; ++i) h_[i] = 0xcbf29ce484222325ULL + i;
+        }
+
+        /**
+         * Lisää tavuja tarkisteeseen.
+         */
+        void lisaa(const void *data, std::size_t n)
+        {
+            const unsigned char *p = static_cast<const unsigned char *>(data);
+            n_ += n;
+            // täytetään ensin edellisen kutsun vajaa lohko
+            while(puskuri_n_ > 0 && n > 0)
+            {
+                puskuri_[puskuri_n_++] = *p++;
+                --n;
+                if(puskuri_n_ == 32)
+                {
+                    lohko(puskuri_);
+                    puskuri_n_ = 0;
+                }
+            }
+            for( ; n >= 32 ; n -= 32, p += 32)
+            {
+                lohko(p);
+            }
+            std::memcpy(puskuri_ + puskuri_n_, p, n);
+            puskuri_n_ += n;
+        }
+
+        /**
+         * Palauttaa lopullisen tarkisteen.
+         */
+        std::uint64_t arvo(void) const
+        {
+            std::uint64_t h[4] = {h_[0], h_[1], h_[2], h_[3]};
+            for(std::size_t i = 0 ; i < puskuri_n_ ; ++i)
+            {
+                h[i % 4] = (h[i % 4] ^ puskuri_[i]) * alkuluku;
+            }
+            std::uint64_t r = n_;
+            for(int i = 0 ; i < 4 ; ++i)
+            {
+                r = (r ^ h[i]) * alkuluku;
+                r ^= r >> 29;
+            }
+            return r;
+        }
+
+    private:
+        static const std::uint64_t alkuluku = 0x100000001b3ULL;
+
+        void lohko(const unsigned char *p)
+        {
+            std::uint64_t w[4];
+            std::memcpy(w, p, 32);
+            for(int i = 0 ; i < 4 ; ++i)
+            {
+                h_[i] = (h_[i] ^ w[i]) * alkuluku;
+            }
+        }
+
+        std::uint64_t h_[4];
+        std::uint64_t n_;
+        unsigned char puskuri_[32];
+        std::size_t puskuri_n_;
+    };
+
+
+    /**
+     * Datan osa kirjoitettavaksi: osoitin ja koko tavuina.
+     */
+    struct binaari_pala
+    {
+        const void *data;
+        std::size_t tavut;
+    };
+
+
+    /**
+     * Kirjoittaa binääritiedoston yhdestä tai useammasta peräkkäisestä palasta.
+     * Palat kirjoitetaan suurina peräkkäisinä kirjoituksina ilman muotoilua.
+     *
+     * @param nimi Tiedoston nimi
+     * @param t Tietotyyppi
+     * @param muoto Taulukon muoto (1-4 ulottuvuutta)
+     * @param palat Kirjoitettava data
+     * @param riveittain true jos data on riveittäin (C), false jos sarakkeittain
+     * @return true jos kirjoitus epäonnistuu
+     */
+    inline bool kirjoita_binaari(const std::string &nimi, dtype t, const std::vector<std::uint64_t> &muoto,
+                                 const std::vector<binaari_pala> &palat, bool riveittain = false)
+    {
+        if(muoto.empty() || muoto.size() > 4)
+        {
+            return true;
+        }
+
+        binaari_otsake o;
+        std::memset(&o, 0, sizeof(o));
+        std::memcpy(o.tunniste, binaari_tunniste, 8);
+        o.versio = binaari_versio;
+        o.tyyppi = static_cast<std::uint32_t>(t);
+        o.ndim = static_cast<std::uint32_t>(muoto.size());
+        o.jarjestys = riveittain ? 1 : 0;
+
+        std::uint64_t alkiot = 1;
+        for(std::size_t i = 0 ; i < 4 ; ++i)
+        {
+            o.muoto[i] = (i < muoto.size()) ? muoto[i] : 1;
+            alkiot *= o.muoto[i];
+        }
+
+        tarkiste64 h;
+        std::uint64_t tavut = 0;
+        for(const auto &p : palat)
+        {
+            h.lisaa(p.data, p.tavut);
+            tavut += p.tavut;
+        }
+        if(tavut != alkiot * dtype_koko(t))
+        {
+            return true;
+        }
+        o.tavut = tavut;
+        o.tarkiste = h.arvo();
+
+        std::FILE *f = std::fopen(nimi.c_str(), "wb");
+        if(!f)
+        {
+            return true;
+        }
+        // ohitetaan stdio:n puskurointi: kirjoitukset ovat jo suuria
+        std::setvbuf(f, nullptr, _IONBF, 0);
+        bool virhe = std::fwrite(&o, sizeof(o), 1, f) != 1;
+        const std::size_t lohko = std::size_t(64) << 20;
+        for(const auto &p : palat)
+        {
+            const char *c = static_cast<const char *>(p.data);
+            for(std::size_t i = 0 ; i < p.tavut && !virhe ; i += lohko)
+            {
+                std::size_t n = std::min(lohko, p.tavut - i);
+                virhe = std::fwrite(c + i, 1, n, f) != n;
+            }
+        }
+        virhe = (std::fclose(f) != 0) || virhe;
+        return virhe;
+    }
+
+
+    /**
+     * Kirjoittaa yhtenäisen taulukon binääritiedostoon.
+     *
+     * @param nimi Tiedoston nimi
+     * @param data Osoitin dataan
+     * @param muoto Taulukon muoto
+     * @param riveittain true jos data on riveittäin
+     * @return true jos kirjoitus epäonnistuu
+     */
+    template<typename T>
+    bool kirjoita_binaari(const std::string &nimi, const T *data, const std::vector<std::uint64_t> &muoto,
+                          bool riveittain = false)
+    {
+        std::uint64_t n = 1;
+        for(auto m : muoto) n *= m;
+        return kirjoita_binaari(nimi, dtype_of<T>::arvo, muoto, {binaari_pala{data, n*sizeof(T)}}, riveittain);
+    }
+
+
+    /**
+     * Binääritiedosto luettuna muistiin mmap:lla.
+     * Data on suoraan tiedoston sivuissa, eikä sitä kopioida.
+     */
+    class binaari_tiedosto
+    {
+    public:
+        binaari_tiedosto() : kartta_(nullptr), koko_(0) {}
+
+        ~binaari_tiedosto()
+        {
+            sulje();
+        }
+
+        binaari_tiedosto(const binaari_tiedosto &) = delete;
+        binaari_tiedosto &operator=(const binaari_tiedosto &) = delete;
+
+        /**
+         * Avaa tiedoston ja tarkistaa otsakkeen.
+         * @param nimi Tiedoston nimi
+         * @return true jos avaus epäonnistuu tai tiedosto ei ole kelvollinen
+         */
+        bool avaa(const std::string &nimi)
+        {
+            sulje();
+            int fd = ::open(nimi.c_str(), O_RDONLY);
+            if(fd < 0)
+            {
+                return true;
+            }
+            struct stat st;
+            if(::fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(binaari_otsake)))
+            {
+                ::close(fd);
+                return true;
+            }
+            void *p = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            ::close(fd);
+            if(p == MAP_FAILED)
+            {
+                return true;
+            }
+            kartta_ = p;
+            koko_ = st.st_size;
+
+            const binaari_otsake &o = otsake();
+            if(std::memcmp(o.tunniste, binaari_tunniste, 8) != 0 || o.versio != binaari_versio
+               || o.ndim < 1 || o.ndim > 4 || o.tavut > koko_ - sizeof(binaari_otsake)
+               || !muoto_kelpaa(o))
+            {
+                sulje();
+                return true;
+            }
+            // luetaan data peräkkäin
+            ::madvise(kartta_, koko_, MADV_SEQUENTIAL);
+            return false;
+        }
+
+        /**
+         * Vapauttaa muistikartan.
+         */
+        void sulje(void)
+        {
+            if(kartta_)
+            {
+                ::munmap(kartta_, koko_);
+            }
+            kartta_ = nullptr;
+            koko_ = 0;
+        }
+
+        const binaari_otsake &otsake(void) const
+        {
+            return *static_cast<const binaari_otsake *>(kartta_);
+        }
+
+        dtype tyyppi(void) const { return static_cast<dtype>(otsake().tyyppi); }
+        std::uint64_t muoto(int i) const { return otsake().muoto[i]; }
+        bool riveittain(void) const { return otsake().jarjestys == 1; }
+        std::uint64_t alkiot(void) const { return otsake().tavut / dtype_koko(tyyppi()); }
+
+        /**
+         * Osoitin dataan. Palauttaa nullptr, jos tyyppi ei täsmää.
+         */
+        template<typename T>
+        const T *data(void) const
+        {
+            if(!kartta_ || tyyppi() != dtype_of<T>::arvo)
+            {
+                return nullptr;
+            }
+            return reinterpret_cast<const T *>(static_cast<const char *>(kartta_) + sizeof(binaari_otsake));
+        }
+
+        /**
+         * Laskee datan tarkisteen uudelleen ja vertaa sitä otsakkeeseen.
+         * @return true jos tarkiste ei täsmää
+         */
+        bool tarkista(void) const
+        {
+            tarkiste64 h;
+            h.lisaa(static_cast<const char *>(kartta_) + sizeof(binaari_otsake), otsake().tavut);
+            return h.arvo() != otsake().tarkiste;
+        }
+
+    private:
+        /**
+         * Tarkistaa, että tietotyyppi on tunnettu ja datan koko on
+         * muoto[0]*...*muoto[3]*dtype_koko (ylivuoto tulkitaan virheeksi).
+         */
+        static bool muoto_kelpaa(const binaari_otsake &o)
+        {
+            const std::uint64_t koko = dtype_koko(static_cast<dtype>(o.tyyppi));
+            if(koko == 0)
+            {
+                return false;
+            }
+            std::uint64_t tavut = koko;
+            for(int i = 0 ; i < 4 ; ++i)
+            {
+                if(o.muoto[i] != 0 && tavut > UINT64_MAX / o.muoto[i])
+                {
+                    return false;
+                }
+                tavut *= o.muoto[i];
+            }
+            return tavut == o.tavut;
+        }
+
+        void *kartta_;
+        std::size_t koko_;
+    };
+
+
+    /**
+     * Muuntaa tekstitiedoston binääriksi.
+     *
+     * Tunnistaa armadillon arma_ascii -otsakkeen (ARMA_MAT_TXT_FN008 tai
+     * ARMA_MAT_TXT_FC016), muuten tiedostoa luetaan välilyönnein erotettuna
+     * taulukkona, jonka rivit tallennetaan riveittäin muodossa (rivit, sarakkeet).
+     *
+     * @param sisaan Tekstitiedosto
+     * @param ulos Binääritiedosto
+     * @return true jos muunnos epäonnistuu
+     */
+    inline bool teksti_binaariksi(const std::string &sisaan, const std::string &ulos)
+    {
+        std::ifstream in(sisaan);
+        if(!in)
+        {
+            return true;
+        }
+        std::string rivi;
+        if(!std::getline(in, rivi))
+        {
+            return true;
+        }
+
+        if(rivi.compare(0, 12, "ARMA_MAT_TXT") == 0)
+        {
+            std::uint64_t r, c;
+            if(!(in >> r >> c))
+            {
+                return true;
+            }
+            bool kompleksi = rivi.find("FC") != std::string::npos;
+            if(kompleksi)
+            {
+                // alkiot muodossa (re,im), tallennetaan sarakkeittain kuten armadillo
+                std::vector<std::complex<double>> a(r*c);
+                for(std::uint64_t i = 0 ; i < r ; ++i)
+                {
+                    for(std::uint64_t j = 0 ; j < c ; ++j)
+                    {
+                        if(!(in >> a[i + j*r])) return true;
+                    }
+                }
+                return kirjoita_binaari(ulos, a.data(), {r, c});
+            }
+            std::vector<double> a(r*c);
+            for(std::uint64_t i = 0 ; i < r ; ++i)
+            {
+                for(std::uint64_t j = 0 ; j < c ; ++j)
+                {
+                    if(!(in >> a[i + j*r])) return true;
+                }
+            }
+            return kirjoita_binaari(ulos, a.data(), {r, c});
+        }
+
+        std::vector<double> a;
+        std::uint64_t sarakkeet = 0;
+        std::uint64_t rivit = 0;
+        do
+        {
+            std::istringstream ss(rivi);
+            double v;
+            std::uint64_t n = 0;
+            while(ss >> v)
+            {
+                a.push_back(v);
+                ++n;
+            }
+            if(n == 0)
+            {
+                continue;
+            }
+            if(sarakkeet == 0)
+            {
+                sarakkeet = n;
+            }
+            if(n != sarakkeet)
+            {
+                return true;
+            }
+            ++rivit;
+        } while(std::getline(in, rivi));
+        return kirjoita_binaari(ulos, a.data(), {rivit, sarakkeet}, true);
+    }
+
+
+    /**
+     * Muuntaa binääritiedoston tekstiksi.
+     *
+     * Kompleksiset matriisit kirjoitetaan arma_ascii -muodossa (kuten A.mat),
+     * reaaliset 1- ja 2-ulotteiset taulukot sarakemuotoisena tekstinä
+     * (kuten xy_data.dat).
+     *
+     * @param sisaan Binääritiedosto
+     * @param ulos Tekstitiedosto
+     * @return true jos muunnos epäonnistuu
+     */
+    inline bool binaari_tekstiksi(const std::string &sisaan, const std::string &ulos)
+    {
+        binaari_tiedosto b;
+        if(b.avaa(sisaan) || b.tarkista() || b.otsake().ndim > 2)
+        {
+            return true;
+        }
+        std::ofstream out(ulos);
+        if(!out)
+        {
+            return true;
+        }
+        const std::uint64_t r = b.muoto(0);
+        const std::uint64_t c = b.muoto(1);
+        // alkion (i,j) indeksi tallennusjärjestyksen mukaan
+        auto indeksi = [&](std::uint64_t i, std::uint64_t j) { return b.riveittain() ? i*c + j : i + j*r; };
+
+        if(b.tyyppi() == dtype::c128)
+        {
+            const std::complex<double> *a = b.data<std::complex<double>>();
+            out << "ARMA_MAT_TXT_FC016\n" << r << " " << c << "\n";
+            out << std::setprecision(17);
+            for(std::uint64_t i = 0 ; i < r ; ++i)
+            {
+                for(std::uint64_t j = 0 ; j < c ; ++j)
+                {
+                    out << " " << a[indeksi(i,j)];
+                }
+                out << '\n';
+            }
+        }
+        else if(b.tyyppi() == dtype::f64)
+        {
+            const double *a = b.data<double>();
+            out << std::setprecision(17);
+            for(std::uint64_t i = 0 ; i < r ; ++i)
+            {
+                for(std::uint64_t j = 0 ; j < c ; ++j)
+                {
+                    out << (j ? " " : "") << a[indeksi(i,j)];
+                }
+                out << '\n';
+            }
+        }
+        else
+        {
+            return true;
+        }
+        return !out.good();
+    }
+}
+
+#endif
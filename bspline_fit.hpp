@@ -0,0 +1,1473 @@
+/**
+ * @file bspline_fit.hpp
+ * @brief FYSA120 B-spline kanta paikallisella tuella
+ * @author keijo.k.a.salonen@student.jyu.fi
+ *
+ * Asteen p B-spline kantafunktioista vain p+1 on nollasta poikkeavia
+ * kussakin pisteessä x. Sen sijaan että jokainen B_i(x) laskettaisiin
+ * rekursiivisesti erikseen, etsitään solmuväli binäärihaulla ja lasketaan
+ * kaikki välin nollasta poikkeavat kantafunktiot kerralla Cox-de Boor
+ * -kolmiolla, O(p^2) operaatiota pistettä kohden.
+ *
+ * Solmuvektorin ei tarvitse olla päistään toistettu (clamped): arvot ovat
+ * samat kuin rekursiivisella määritelmällä koko välillä [t_0, t_{m-1}].
+ * Välin oikea päätepiste luetaan viimeiseen epätyhjään solmuväliin.
+ *
+ * Pienimmän neliösumman sovitus ratkaistaan kaistamuotoisella QR-hajotelmalla
+ * (Givensin kierrot), joka muodostetaan suoraan paikallisista kantafunktioista
+ * ilman suunnittelumatriisia: aika O(N p^2 + M p) ja muisti O(M p), kun x on
+ * kasvavassa järjestyksessä (muuten lisäksi O(N) järjestysindeksit).
+ *
+ * Sovitettu käyrä lasketaan suoraan de Boorin algoritmilla (bspline_kayra)
+ * ilman kantafunktiomatriisia.
+ *
+ * Jatkuvasti saapuvalle datalle bspline_virta päivittää samaa kaistamuotoista
+ * R-tekijää näyte kerrallaan, valinnaisesti eksponentiaalisella unohduksella.
+ *
+ * Hiladatan tensoritulopinta (sovita_pinta, bspline_pinta) ratkaistaan
+ * kahdella 1D kaistamuotoisella hajotelmalla Kroneckerin rakennetta käyttäen.
+ *
+ * Tasoitettu sovitus (bspline_tasoitus) lisää kertoimien erotussakon ja
+ * valitsee sen painon yleistetyllä ristiinvalidoinnilla.
+ */
+#ifndef FYSA120_BSPLINE_FIT_HPP
+#define FYSA120_BSPLINE_FIT_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <armadillo>
+
+/**
+ * fysa120 nimiavaruus
+ */
+namespace fysa120
+{
+    /**
+     * B-spline kanta, jonka kantafunktiot lasketaan paikallisesti.
+     */
+    class bspline_kanta
+    {
+    public:
+        static const int max_aste = 15;
+
+        /**
+         * @param t Solmuvektori (ei-vähenevä)
+         * @param p Kantafunktioiden aste
+         */
+        bspline_kanta(const std::vector<double> &t, int p) : t_(t), p_(p)
+        {
+            if(p < 0 || p > max_aste || t.size() < static_cast<std::size_t>(p + 2)
+               || !std::is_sorted(t.begin(), t.end()) || t.front() == t.back())
+            {
+                throw std::invalid_argument("bspline_kanta: virheellinen solmuvektori tai aste");
+            }
+            // viimeinen epätyhjä solmuväli oikeaa päätepistettä varten
+            viimeinen_ = static_cast<int>(std::lower_bound(t_.begin(), t_.end(), t_.back()) - t_.begin()) - 1;
+        }
+
+        /** Kantafunktioiden aste p. */
+        int aste(void) const { return p_; }
+
+        /** Kantafunktioiden lukumäärä M = m - p - 1. */
+        int maara(void) const { return static_cast<int>(t_.size()) - p_ - 1; }
+
+        /** Solmuvektori. */
+        const std::vector<double> &solmut(void) const { return t_; }
+
+        /**
+         * Etsii solmuvälin j, jolle t_j <= x < t_{j+1}, binäärihaulla.
+         * @return j tai -1 jos x on solmuvektorin ulkopuolella
+         */
+        int vali(double x) const
+        {
+            if(x < t_.front() || x > t_.back())
+            {
+                return -1;
+            }
+            if(x == t_.back())
+            {
+                return viimeinen_;
+            }
+            return static_cast<int>(std::upper_bound(t_.begin(), t_.end(), x) - t_.begin()) - 1;
+        }
+
+        /**
+         * Laskee kaikki pisteessä x nollasta poikkeavat kantafunktiot.
+         *
+         * @param x Piste
+         * @param N Taulukko, johon kirjoitetaan p+1 arvoa B_{i0}(x) ... B_{i0+p}(x)
+         * @return Ensimmäisen kantafunktion indeksi i0 (voi olla negatiivinen
+         *         tai i0+p >= M; olemattomien kantafunktioiden arvot ovat nollia)
+         */
+        int arvot(double x, double *N) const
+        {
+            return arvot(x, vali(x), N);
+        }
+
+        /**
+         * Kuten arvot(x, N), kun solmuväli j on jo tiedossa.
+         */
+        int arvot(double x, int j, double *N) const
+        {
+            const int m = static_cast<int>(t_.size());
+            if(j < 0)
+            {
+                std::fill(N, N + p_ + 1, 0.0);
+                return 0;
+            }
+            // Cox-de Boor kolmio: asteella d N[r] = B_{j-d+r,d}(x), r = 0..d
+            double vanha[max_aste + 1];
+            N[0] = 1.0;
+            for(int d = 1 ; d <= p_ ; ++d)
+            {
+                std::copy(N, N + d, vanha);
+                for(int r = 0 ; r <= d ; ++r)
+                {
+                    const int i = j - d + r;
+                    double v = 0.0;
+                    // kantafunktiota B_{i,d} ei ole, jos sen solmut eivät mahdu vektoriin
+                    if(i >= 0 && i + d + 1 <= m - 1)
+                    {
+                        if(r >= 1)
+                        {
+                            const double h = t_[i+d] - t_[i];
+                            if(h > 0.0) v += (x - t_[i]) / h * vanha[r-1];
+                        }
+                        if(r <= d - 1)
+                        {
+                            const double h = t_[i+d+1] - t_[i+1];
+                            if(h > 0.0) v += (t_[i+d+1] - x) / h * vanha[r];
+                        }
+                    }
+                    N[r] = v;
+                }
+            }
+            return j - p_;
+        }
+
+    private:
+        std::vector<double> t_;
+        int p_;
+        int viimeinen_;
+    };
+
+
+    /**
+     * Kaistamuotoinen suunnittelumatriisi A_ij = B_j(x_i): jokaisella rivillä
+     * on p+1 peräkkäistä arvoa alkaen sarakkeesta alku[i].
+     * Sarakkeet < 0 tai >= M ovat nollia.
+     */
+    struct kaistamatriisi
+    {
+        int rivit;
+        int sarakkeet;
+        int leveys;                 ///< p+1
+        std::vector<int> alku;
+        std::vector<double> arvot;  ///< rivit*leveys arvoa riveittäin
+
+        /**
+         * Muuntaa armadillon harvaksi matriisiksi.
+         */
+        arma::sp_mat harva(void) const
+        {
+            std::size_t nnz = 0;
+            for(int i = 0 ; i < rivit ; ++i)
+            {
+                for(int r = 0 ; r < leveys ; ++r)
+                {
+                    int j = alku[i] + r;
+                    if(j >= 0 && j < sarakkeet && arvot[i*leveys + r] != 0.0) ++nnz;
+                }
+            }
+            arma::umat paikat(2, nnz);
+            arma::vec a(nnz);
+            std::size_t n = 0;
+            for(int i = 0 ; i < rivit ; ++i)
+            {
+                for(int r = 0 ; r < leveys ; ++r)
+                {
+                    int j = alku[i] + r;
+                    double v = arvot[i*leveys + r];
+                    if(j >= 0 && j < sarakkeet && v != 0.0)
+                    {
+                        paikat(0,n) = i;
+                        paikat(1,n) = j;
+                        a[n] = v;
+                        ++n;
+                    }
+                }
+            }
+            return arma::sp_mat(paikat, a, rivit, sarakkeet);
+        }
+    };
+
+
+    /**
+     * Muodostaa suunnittelumatriisin pisteille x, O(N p^2).
+     *
+     * @param kanta B-spline kanta
+     * @param x Pisteet
+     * @param n Pisteiden määrä
+     * @return Kaistamuotoinen suunnittelumatriisi
+     */
+    inline kaistamatriisi suunnittelumatriisi(const bspline_kanta &kanta, const double *x, std::size_t n)
+    {
+        kaistamatriisi A;
+        A.rivit = static_cast<int>(n);
+        A.sarakkeet = kanta.maara();
+        A.leveys = kanta.aste() + 1;
+        A.alku.resize(n);
+        A.arvot.resize(n * A.leveys);
+        for(std::size_t i = 0 ; i < n ; ++i)
+        {
+            A.alku[i] = kanta.arvot(x[i], &A.arvot[i * A.leveys]);
+        }
+        return A;
+    }
+
+
+    /**
+     * Kaistamuotoinen QR-hajotelma Givensin kierroilla.
+     *
+     * Yläkolmiomatriisin R alkiot R(j, j+d), d = 0..p, talletetaan riveittäin
+     * taulukkoon R[j*(p+1) + d]. Lisäksi pidetään oikea puoli z = Q^T y ja
+     * jäännösneliösumma. Kun rivit lisätään alkusarakkeen mukaan
+     * kasvavassa järjestyksessä, R:n kaistan ulkopuolelle ei synny täyttöä ja
+     * rivin lisäys maksaa O(p^2). Muussa järjestyksessä kierto jatkuu, kunnes
+     * rivi on nollattu, mikä voi maksaa O(M p).
+     */
+    class kaista_qr
+    {
+    public:
+        /**
+         * @param M Tuntemattomien määrä
+         * @param p Kaistan leveys - 1 (B-splinin aste)
+         */
+        kaista_qr(int M, int p) : M_(M), w_(p + 1), R_(static_cast<std::size_t>(M) * (p + 1), 0.0),
+                                  z_(M, 0.0), jaannos_(0.0), rivit_(0)
+        {
+        }
+
+        int maara(void) const { return M_; }
+        int leveys(void) const { return w_; }
+        std::size_t rivit(void) const { return rivit_; }
+
+        /** Jäännösneliösumma ||Ac - y||^2 tähän mennessä lisätyille riveille. */
+        double jaannos(void) const { return jaannos_; }
+
+        /** R:n alkio R(j, j+d). */
+        double r(int j, int d) const { return R_[static_cast<std::size_t>(j)*w_ + d]; }
+
+        /**
+         * Lisää rivin a (p+1 arvoa alkaen sarakkeesta alku) ja oikean puolen arvon y.
+         * Sarakkeet < 0 tai >= M jätetään huomiotta.
+         */
+        void lisaa_rivi(int alku, const double *a, double y)
+        {
+            double v[bspline_kanta::max_aste + 1];
+            int j = alku;
+            for(int d = 0 ; d < w_ ; ++d)
+            {
+                int s = alku + d;
+                v[d] = (s >= 0 && s < M_) ? a[d] : 0.0;
+            }
+            // siirretään ikkuna ensimmäiseen nollasta poikkeavaan sarakkeeseen
+            int ensimmainen = 0;
+            while(ensimmainen < w_ && v[ensimmainen] == 0.0) ++ensimmainen;
+            if(ensimmainen == w_)
+            {
+                jaannos_ += y*y;
+                ++rivit_;
+                return;
+            }
+            j += ensimmainen;
+            for(int d = 0 ; d < w_ ; ++d)
+            {
+                v[d] = (d + ensimmainen < w_) ? v[d + ensimmainen] : 0.0;
+            }
+            kierra(j, v, y);
+            ++rivit_;
+        }
+
+        /**
+         * Skaalaa koko hajotelman kertoimella k (R ja z), esim. unohduskertoimelle.
+         */
+        void skaalaa(double k)
+        {
+            for(auto &r : R_) r *= k;
+            for(auto &z : z_) z *= k;
+            jaannos_ *= k*k;
+        }
+
+        /**
+         * Ratkaisee kertoimet takaisinsijoituksella, O(M p).
+         *
+         * @param c Ratkaisu
+         * @param kunto Kuntoisuusluvun arvio max|R_jj| / min|R_jj| (alaraja cond(A):lle)
+         * @param max_kunto Suurin hyväksyttävä kuntoisuusluku
+         * @return true jos R on singulaarinen tai huonokuntoinen
+         */
+        bool ratkaise(std::vector<double> &c, double &kunto, double max_kunto = 1.0e12) const
+        {
+            kunto = this->kunto();
+            c.assign(M_, 0.0);
+            if(!(kunto <= max_kunto))
+            {
+                return true;
+            }
+            for(int j = M_ - 1 ; j >= 0 ; --j)
+            {
+                double s = z_[j];
+                for(int d = 1 ; d < w_ && j + d < M_ ; ++d)
+                {
+                    s -= r(j,d) * c[j+d];
+                }
+                c[j] = s / r(j,0);
+            }
+            return false;
+        }
+
+        /**
+         * Kuntoisuusluvun arvio max|R_jj| / min|R_jj| (alaraja cond(A):lle).
+         */
+        double kunto(void) const
+        {
+            double suurin = 0.0;
+            double pienin = std::numeric_limits<double>::infinity();
+            for(int j = 0 ; j < M_ ; ++j)
+            {
+                double d = std::abs(r(j,0));
+                suurin = std::max(suurin, d);
+                pienin = std::min(pienin, d);
+            }
+            return (pienin > 0.0) ? suurin / pienin : std::numeric_limits<double>::infinity();
+        }
+
+        /**
+         * Ratkaisee R^T R X = B usealle oikealle puolelle (semi-normaaliyhtälöt),
+         * O(M p) saraketta kohden. B on M x k -matriisi riveittäin (rivin pituus ld),
+         * ja sen sarakkeet [s0, s1) korvataan ratkaisulla. Sisin silmukka kulkee
+         * sarakkeiden yli, joten rivioperaatiot ovat peräkkäisessä muistissa.
+         */
+        void ratkaise_normaali(double *B, std::size_t ld, std::size_t s0, std::size_t s1) const
+        {
+            // R^T w = b eteenpäin
+            for(int j = 0 ; j < M_ ; ++j)
+            {
+                double *Bj = B + static_cast<std::size_t>(j)*ld;
+                for(int d = 1 ; d < w_ && d <= j ; ++d)
+                {
+                    const double a = r(j-d, d);
+                    const double *Bi = B + static_cast<std::size_t>(j-d)*ld;
+                    for(std::size_t s = s0 ; s < s1 ; ++s) Bj[s] -= a * Bi[s];
+                }
+                const double k = 1.0 / r(j,0);
+                for(std::size_t s = s0 ; s < s1 ; ++s) Bj[s] *= k;
+            }
+            // R x = w taaksepäin
+            for(int j = M_ - 1 ; j >= 0 ; --j)
+            {
+                double *Bj = B + static_cast<std::size_t>(j)*ld;
+                for(int d = 1 ; d < w_ && j + d < M_ ; ++d)
+                {
+                    const double a = r(j,d);
+                    const double *Bi = B + static_cast<std::size_t>(j+d)*ld;
+                    for(std::size_t s = s0 ; s < s1 ; ++s) Bj[s] -= a * Bi[s];
+                }
+                const double k = 1.0 / r(j,0);
+                for(std::size_t s = s0 ; s < s1 ; ++s) Bj[s] *= k;
+            }
+        }
+
+    private:
+        /**
+         * Kiertää rivin v (sarakkeet j..j+p) R:ään riviltä j alkaen.
+         */
+        void kierra(int j, double *v, double y)
+        {
+            for( ; j < M_ ; ++j)
+            {
+                if(v[0] != 0.0)
+                {
+                    double *Rj = &R_[static_cast<std::size_t>(j)*w_];
+                    double h = std::hypot(Rj[0], v[0]);
+                    double cs = Rj[0] / h;
+                    double sn = v[0] / h;
+                    for(int d = 0 ; d < w_ ; ++d)
+                    {
+                        double a = Rj[d];
+                        Rj[d] = cs*a + sn*v[d];
+                        v[d] = -sn*a + cs*v[d];
+                    }
+                    double zj = z_[j];
+                    z_[j] = cs*zj + sn*y;
+                    y = -sn*zj + cs*y;
+                }
+                // siirretään ikkunaa yksi sarake oikealle
+                bool nolla = true;
+                for(int d = 0 ; d + 1 < w_ ; ++d)
+                {
+                    v[d] = v[d+1];
+                    nolla = nolla && (v[d] == 0.0);
+                }
+                v[w_-1] = 0.0;
+                if(nolla)
+                {
+                    break;
+                }
+            }
+            jaannos_ += y*y;
+        }
+
+        int M_;
+        int w_;
+        std::vector<double> R_;
+        std::vector<double> z_;
+        double jaannos_;
+        std::size_t rivit_;
+    };
+
+
+    /**
+     * Järjestää pisteet solmuvälin mukaan laskentalajittelulla, O(N + m).
+     * @return Pisteiden indeksit kasvavan solmuvälin järjestyksessä
+     */
+    inline std::vector<std::size_t> jarjesta_valeittain(const bspline_kanta &kanta, const double *x, std::size_t n)
+    {
+        const std::size_t m = kanta.solmut().size();
+        std::vector<int> vali(n);
+        std::vector<std::size_t> lkm(m + 1, 0);
+        for(std::size_t i = 0 ; i < n ; ++i)
+        {
+            vali[i] = kanta.vali(x[i]) + 1;    // -1 (ulkopuolella) -> 0
+            ++lkm[vali[i] + 1];
+        }
+        for(std::size_t k = 1 ; k <= m ; ++k) lkm[k] += lkm[k-1];
+        std::vector<std::size_t> jarjestys(n);
+        for(std::size_t i = 0 ; i < n ; ++i)
+        {
+            jarjestys[lkm[vali[i]]++] = i;
+        }
+        return jarjestys;
+    }
+
+
+    /**
+     * Kutsuu f(i) jokaiselle pisteelle solmuvälin mukaan kasvavassa järjestyksessä.
+     * Jos x on jo kasvavassa järjestyksessä, pisteet käydään läpi suoraan ilman
+     * lisämuistia; muuten järjestys haetaan jarjesta_valeittain():lla, joka vie
+     * O(N) muistia indekseille.
+     */
+    template<typename F>
+    void valeittain(const bspline_kanta &kanta, const double *x, std::size_t n, F f)
+    {
+        if(std::is_sorted(x, x + n))
+        {
+            for(std::size_t i = 0 ; i < n ; ++i) f(i);
+            return;
+        }
+        for(std::size_t i : jarjesta_valeittain(kanta, x, n)) f(i);
+    }
+
+
+    /**
+     * B-spline pienimmän neliösumman sovitus kaistamuotoisella QR:llä.
+     *
+     * Pisteet käsitellään solmuvälin mukaan järjestyksessä, ja jokainen piste
+     * maksaa O(p^2). Kasvavassa järjestyksessä annetuille pisteille muistia
+     * tarvitaan vain O(M p); muuten järjestämiseen tarvitaan lisäksi O(N)
+     * indeksitaulukko (ks. valeittain).
+     *
+     * @param kanta B-spline kanta
+     * @param x Pisteiden x-koordinaatit
+     * @param y Pisteiden y-koordinaatit
+     * @param n Pisteiden määrä
+     * @param c Sovitetut kertoimet
+     * @param kunto Kuntoisuusluvun arvio (ks. kaista_qr::ratkaise)
+     * @param max_kunto Suurin hyväksyttävä kuntoisuusluku
+     * @return true jos sovitus epäonnistuu (esim. kantafunktiolla ei ole dataa)
+     */
+    inline bool sovita_kaista(const bspline_kanta &kanta, const double *x, const double *y, std::size_t n,
+                              std::vector<double> &c, double &kunto, double max_kunto = 1.0e12)
+    {
+        kaista_qr qr(kanta.maara(), kanta.aste());
+        double N[bspline_kanta::max_aste + 1];
+        valeittain(kanta, x, n, [&](std::size_t i){
+            int i0 = kanta.arvot(x[i], N);
+            qr.lisaa_rivi(i0, N, y[i]);
+        });
+        return qr.ratkaise(c, kunto, max_kunto);
+    }
+
+
+    /**
+     * B-spline käyrä s(x) = sum_i c_i B_i(x), joka lasketaan de Boorin algoritmilla.
+     *
+     * Solmuvektoria jatketaan p:llä päätesolmulla kumpaankin päähän ja
+     * kertoimia p:llä nollalla, jolloin de Boorin algoritmi toimii koko välillä
+     * [t_0, t_{m-1}] myös toistamattomalla solmuvektorilla ja antaa saman
+     * tuloksen kuin kantafunktioiden summa. Välin ulkopuolella s(x) = 0.
+     */
+    class bspline_kayra
+    {
+    public:
+        /**
+         * @param kanta B-spline kanta
+         * @param c Kertoimet (M kpl)
+         */
+        bspline_kayra(const bspline_kanta &kanta, const std::vector<double> &c) : p_(kanta.aste())
+        {
+            if(static_cast<int>(c.size()) != kanta.maara())
+            {
+                throw std::invalid_argument("bspline_kayra: kertoimien määrä ei vastaa kantaa");
+            }
+            const std::vector<double> &t = kanta.solmut();
+            t_.assign(p_, t.front());
+            t_.insert(t_.end(), t.begin(), t.end());
+            t_.insert(t_.end(), p_, t.back());
+            c_.assign(p_, 0.0);
+            c_.insert(c_.end(), c.begin(), c.end());
+            c_.insert(c_.end(), p_, 0.0);
+            ala_ = p_;
+            // viimeinen epätyhjä väli jatketussa vektorissa
+            yla_ = static_cast<int>(std::lower_bound(t_.begin(), t_.end(), t.back()) - t_.begin()) - 1;
+        }
+
+        /**
+         * Käyrän arvo yhdessä pisteessä.
+         */
+        double operator()(double x) const
+        {
+            int k = vali(x, ala_);
+            return (k < 0) ? 0.0 : de_boor(x, k);
+        }
+
+        /**
+         * Laskee käyrän arvot pisteissä x[0..n-1].
+         *
+         * Pisteiden ei tarvitse olla järjestyksessä, mutta järjestetyillä
+         * pisteillä edellinen solmuväli käytetään uudelleen ilman hakua.
+         * Pisteet käsitellään lohkoissa, joiden sisällä de Boorin kolmio
+         * lasketaan kaikille pisteille kerralla (vektoroitava sisin silmukka).
+         *
+         * @param x Pisteet
+         * @param y Tulokset
+         * @param n Pisteiden määrä
+         * @param saikeet Säikeiden määrä, 0 = laitteiston säikeet
+         */
+        void arvioi(const double *x, double *y, std::size_t n, unsigned saikeet = 0) const
+        {
+            if(saikeet == 0)
+            {
+                saikeet = std::max(1u, std::thread::hardware_concurrency());
+            }
+            // pienillä määrillä säikeiden luonti ei kannata
+            const std::size_t min_pala = 1 << 15;
+            saikeet = static_cast<unsigned>(std::min<std::size_t>(saikeet, (n + min_pala - 1) / min_pala));
+            if(saikeet <= 1)
+            {
+                arvioi_pala(x, y, n);
+                return;
+            }
+            std::vector<std::thread> s;
+            const std::size_t pala = (n + saikeet - 1) / saikeet;
+            for(unsigned i = 0 ; i < saikeet ; ++i)
+            {
+                std::size_t a = i * pala;
+                std::size_t b = std::min(n, a + pala);
+                if(a >= b) break;
+                s.emplace_back([this, x, y, a, b]{ arvioi_pala(x + a, y + a, b - a); });
+            }
+            for(auto &t : s) t.join();
+        }
+
+    private:
+        static const int lohko = 64;
+
+        /**
+         * Jatketun solmuvektorin väli k, jolle t_k <= x < t_{k+1}.
+         * Aloitetaan arvauksesta k0 ja siirrytään muutama väli eteenpäin
+         * ennen binäärihakua. @return -1 jos x on välin ulkopuolella
+         */
+        int vali(double x, int k0) const
+        {
+            if(!(x >= t_[ala_] && x <= t_[yla_ + 1]))
+            {
+                return -1;
+            }
+            if(x == t_[yla_ + 1])
+            {
+                return yla_;
+            }
+            int k = k0;
+            for(int askel = 0 ; askel < 4 && k <= yla_ ; ++askel, ++k)
+            {
+                if(t_[k] <= x && x < t_[k+1])
+                {
+                    return k;
+                }
+                if(x < t_[k])
+                {
+                    break;
+                }
+            }
+            return static_cast<int>(std::upper_bound(t_.begin() + ala_, t_.begin() + yla_ + 1, x) - t_.begin()) - 1;
+        }
+
+        /**
+         * de Boorin algoritmi yhdelle pisteelle välillä k.
+         */
+        double de_boor(double x, int k) const
+        {
+            double d[bspline_kanta::max_aste + 1];
+            for(int r = 0 ; r <= p_ ; ++r)
+            {
+                d[r] = c_[k - p_ + r];
+            }
+            for(int r = 1 ; r <= p_ ; ++r)
+            {
+                for(int j = p_ ; j >= r ; --j)
+                {
+                    const double a = t_[j + k - p_];
+                    const double alfa = (x - a) / (t_[j + 1 + k - r] - a);
+                    d[j] = (1.0 - alfa) * d[j-1] + alfa * d[j];
+                }
+            }
+            return d[p_];
+        }
+
+        /**
+         * Laskee yhden säikeen osuuden lohkoittain.
+         */
+        void arvioi_pala(const double *x, double *y, std::size_t n) const
+        {
+            int k[lohko];
+            double d[bspline_kanta::max_aste + 1][lohko];
+            double a[lohko];
+            double b[lohko];
+            int edellinen = ala_;
+            for(std::size_t alku = 0 ; alku < n ; alku += lohko)
+            {
+                const int L = static_cast<int>(std::min<std::size_t>(lohko, n - alku));
+                const double *xl = x + alku;
+
+                // solmuvälit ja kertoimet
+                for(int i = 0 ; i < L ; ++i)
+                {
+                    int v = vali(xl[i], edellinen);
+                    if(v >= 0) edellinen = v;
+                    // ulkopuoliset pisteet lasketaan kelvollisella välillä ja nollataan lopuksi
+                    k[i] = (v < 0) ? -1 : v;
+                    int kk = (v < 0) ? ala_ : v;
+                    for(int r = 0 ; r <= p_ ; ++r)
+                    {
+                        d[r][i] = c_[kk - p_ + r];
+                    }
+                }
+
+                // de Boorin kolmio kaikille lohkon pisteille
+                for(int r = 1 ; r <= p_ ; ++r)
+                {
+                    for(int j = p_ ; j >= r ; --j)
+                    {
+                        for(int i = 0 ; i < L ; ++i)
+                        {
+                            int kk = (k[i] < 0) ? ala_ : k[i];
+                            a[i] = t_[j + kk - p_];
+                            b[i] = t_[j + 1 + kk - r];
+                        }
+                        for(int i = 0 ; i < L ; ++i)
+                        {
+                            const double alfa = (xl[i] - a[i]) / (b[i] - a[i]);
+                            d[j][i] = (1.0 - alfa) * d[j-1][i] + alfa * d[j][i];
+                        }
+                    }
+                }
+
+                for(int i = 0 ; i < L ; ++i)
+                {
+                    y[alku + i] = (k[i] < 0) ? 0.0 : d[p_][i];
+                }
+            }
+        }
+
+        int p_;
+        int ala_;   ///< ensimmäinen kelvollinen väli jatketussa vektorissa
+        int yla_;   ///< viimeinen kelvollinen (epätyhjä) väli
+        std::vector<double> t_;
+        std::vector<double> c_;
+    };
+
+
+    /**
+     * Inkrementaalinen B-spline sovitus jatkuvasti saapuvalle datalle.
+     *
+     * Jokainen näyte (x, y) kierretään kaistamuotoiseen R-tekijään Givensin
+     * kierroilla. Kun x ei pienene (esim. aikasarja), päivitys maksaa O(p^2);
+     * muussa järjestyksessä kierto voi jatkua O(M p) verran. Kertoimet saa
+     * milloin tahansa takaisinsijoituksella, O(M p).
+     *
+     * Unohduskertoimella 0 < lambda < 1 minimoidaan sum_i lambda^(n-i) r_i^2.
+     * R:n skaalaamisen sijaan uusia rivejä painotetaan kasvavalla kertoimella
+     * lambda^(-n/2), ja koko hajotelma normeerataan vain, kun kerroin kasvaa
+     * suureksi, joten unohdus ei lisää näytekohtaista työtä.
+     */
+    class bspline_virta
+    {
+    public:
+        /**
+         * @param kanta B-spline kanta
+         * @param unohdus Unohduskerroin lambda, 1 = ei unohdusta
+         */
+        bspline_virta(const bspline_kanta &kanta, double unohdus = 1.0)
+            : kanta_(kanta), qr_(kanta.maara(), kanta.aste()), kasvu_(1.0 / std::sqrt(unohdus)),
+              paino_(1.0), naytteet_(0)
+        {
+            if(!(unohdus > 0.0 && unohdus <= 1.0))
+            {
+                throw std::invalid_argument("bspline_virta: unohduskertoimen oltava välillä (0,1]");
+            }
+        }
+
+        /**
+         * Lisää yhden näytteen.
+         */
+        void lisaa(double x, double y)
+        {
+            double N[bspline_kanta::max_aste + 1];
+            int i0 = kanta_.arvot(x, N);
+            if(paino_ != 1.0)
+            {
+                for(int r = 0 ; r <= kanta_.aste() ; ++r) N[r] *= paino_;
+                y *= paino_;
+            }
+            qr_.lisaa_rivi(i0, N, y);
+            ++naytteet_;
+
+            paino_ *= kasvu_;
+            if(paino_ > 1.0e100)
+            {
+                qr_.skaalaa(1.0 / paino_);
+                paino_ = 1.0;
+            }
+        }
+
+        /**
+         * Nykyiset kertoimet.
+         * @param c Kertoimet
+         * @param kunto Kuntoisuusluvun arvio (ks. kaista_qr::ratkaise)
+         * @param max_kunto Suurin hyväksyttävä kuntoisuusluku
+         * @return true jos kertoimia ei voida vielä määrätä (liian vähän dataa)
+         */
+        bool kertoimet(std::vector<double> &c, double &kunto, double max_kunto = 1.0e12) const
+        {
+            return qr_.ratkaise(c, kunto, max_kunto);
+        }
+
+        /** Painotettu jäännösneliösumma suhteessa viimeisimmän näytteen painoon. */
+        double jaannos(void) const
+        {
+            double w = paino_ / kasvu_;
+            return qr_.jaannos() / (w*w);
+        }
+
+        std::size_t naytteet(void) const { return naytteet_; }
+
+    private:
+        bspline_kanta kanta_;
+        kaista_qr qr_;
+        double kasvu_;      ///< lambda^(-1/2)
+        double paino_;      ///< seuraavan näytteen paino
+        std::size_t naytteet_;
+    };
+
+
+    /**
+     * Jakaa välin [0, n) enintään saikeet osaan ja kutsuu f(a, b) kullekin
+     * osalle omassa säikeessään. Osan koko on vähintään min_pala ja tasaus:n
+     * monikerta (ettei kaksi säiettä kirjoita samalle välimuistiriville).
+     * @param saikeet Säikeiden määrä, 0 = laitteiston säikeet
+     */
+    template<typename F>
+    inline void rinnakkain(std::size_t n, unsigned saikeet, std::size_t min_pala, std::size_t tasaus, const F &f)
+    {
+        if(saikeet == 0)
+        {
+            saikeet = std::max(1u, std::thread::hardware_concurrency());
+        }
+        min_pala = std::max<std::size_t>(min_pala, 1);
+        saikeet = static_cast<unsigned>(std::min<std::size_t>(saikeet, (n + min_pala - 1) / min_pala));
+        if(saikeet <= 1)
+        {
+            f(std::size_t(0), n);
+            return;
+        }
+        std::size_t pala = (n + saikeet - 1) / saikeet;
+        pala = (pala + tasaus - 1) / tasaus * tasaus;
+        std::vector<std::thread> s;
+        for(std::size_t a = 0 ; a < n ; a += pala)
+        {
+            std::size_t b = std::min(n, a + pala);
+            s.emplace_back([&f, a, b]{ f(a, b); });
+        }
+        for(auto &t : s) t.join();
+    }
+
+
+    /**
+     * Pienimmän neliösumman sovitus samalla kannalla usealle oikealle puolelle:
+     * X = (A^T A)^{-1} A^T Z, missä A_ij = B_j(x_i).
+     *
+     * A:n kaistamuotoinen R muodostetaan kerran, O(n p^2), minkä jälkeen
+     * jokainen sarake maksaa O(n p + M p): A^T z kerätään paikallisista
+     * kantafunktioista ja R^T R x = A^T z ratkaistaan kaistamuotoisena.
+     * Sarakkeet jaetaan säikeille.
+     *
+     * Semi-normaaliyhtälöt neliöivät kuntoisuusluvun, joten ratkaisua
+     * korjataan yhdellä iteraatioaskeleella alkuperäisellä A:lla
+     * (r = z - A x, R^T R d = A^T r, x += d), ja sovitus hylätään, jos
+     * kunto^2 > max_kunto.
+     *
+     * @param kanta B-spline kanta
+     * @param x Pisteet (n kpl)
+     * @param n Pisteiden määrä
+     * @param Z Oikeat puolet, n x k riveittäin
+     * @param k Oikeiden puolten määrä
+     * @param X Ratkaisu, M x k riveittäin
+     * @param kunto Kuntoisuusluvun arvio (ks. kaista_qr::kunto)
+     * @param saikeet Säikeiden määrä, 0 = laitteiston säikeet
+     * @param max_kunto Suurin hyväksyttävä kuntoisuusluku A^T A:lle (kunto^2)
+     * @return true jos R on singulaarinen tai huonokuntoinen
+     */
+    inline bool sovita_sarakkeet(const bspline_kanta &kanta, const double *x, std::size_t n,
+                                 const double *Z, std::size_t k, std::vector<double> &X,
+                                 double &kunto, unsigned saikeet = 0, double max_kunto = 1.0e12)
+    {
+        const kaistamatriisi A = suunnittelumatriisi(kanta, x, n);
+        const int M = A.sarakkeet;
+        kaista_qr qr(M, kanta.aste());
+        valeittain(kanta, x, n, [&](std::size_t i){
+            qr.lisaa_rivi(A.alku[i], &A.arvot[i * A.leveys], 0.0);
+        });
+        kunto = qr.kunto();
+        X.assign(static_cast<std::size_t>(M) * k, 0.0);
+        if(!(kunto * kunto <= max_kunto))
+        {
+            return true;
+        }
+
+        rinnakkain(k, saikeet, 64, 8, [&](std::size_t s0, std::size_t s1){
+            // A^T Z sarakkeille s0..s1-1
+            for(std::size_t i = 0 ; i < n ; ++i)
+            {
+                const double *Zi = Z + i*k;
+                for(int r = 0 ; r < A.leveys ; ++r)
+                {
+                    const int j = A.alku[i] + r;
+                    const double a = A.arvot[i * A.leveys + r];
+                    if(j < 0 || j >= M || a == 0.0)
+                    {
+                        continue;
+                    }
+                    double *Xj = &X[static_cast<std::size_t>(j) * k];
+                    for(std::size_t s = s0 ; s < s1 ; ++s) Xj[s] += a * Zi[s];
+                }
+            }
+            qr.ratkaise_normaali(X.data(), k, s0, s1);
+
+            // korjausaskel: W = (R^T R)^{-1} A^T (Z - A X), W on M x w riveittäin
+            const std::size_t w = s1 - s0;
+            std::vector<double> W(static_cast<std::size_t>(M) * w, 0.0);
+            std::vector<double> r(w);
+            for(std::size_t i = 0 ; i < n ; ++i)
+            {
+                const int j0 = A.alku[i];
+                const double *a = &A.arvot[i * A.leveys];
+                std::copy(Z + i*k + s0, Z + i*k + s1, r.begin());
+                for(int d = 0 ; d < A.leveys ; ++d)
+                {
+                    const int j = j0 + d;
+                    if(j < 0 || j >= M || a[d] == 0.0) continue;
+                    const double *Xj = &X[static_cast<std::size_t>(j) * k + s0];
+                    for(std::size_t t = 0 ; t < w ; ++t) r[t] -= a[d] * Xj[t];
+                }
+                for(int d = 0 ; d < A.leveys ; ++d)
+                {
+                    const int j = j0 + d;
+                    if(j < 0 || j >= M || a[d] == 0.0) continue;
+                    double *Wj = &W[static_cast<std::size_t>(j) * w];
+                    for(std::size_t t = 0 ; t < w ; ++t) Wj[t] += a[d] * r[t];
+                }
+            }
+            qr.ratkaise_normaali(W.data(), w, 0, w);
+            for(int j = 0 ; j < M ; ++j)
+            {
+                double *Xj = &X[static_cast<std::size_t>(j) * k + s0];
+                const double *Wj = &W[static_cast<std::size_t>(j) * w];
+                for(std::size_t t = 0 ; t < w ; ++t) Xj[t] += Wj[t];
+            }
+        });
+        return false;
+    }
+
+
+    /**
+     * Transponoi riveittäin talletetun r x s -matriisin A matriisiksi B (s x r).
+     */
+    inline void transponoi(const double *A, std::size_t r, std::size_t s, double *B)
+    {
+        const std::size_t L = 32;
+        for(std::size_t i0 = 0 ; i0 < r ; i0 += L)
+        {
+            for(std::size_t j0 = 0 ; j0 < s ; j0 += L)
+            {
+                const std::size_t i1 = std::min(r, i0 + L);
+                const std::size_t j1 = std::min(s, j0 + L);
+                for(std::size_t i = i0 ; i < i1 ; ++i)
+                {
+                    for(std::size_t j = j0 ; j < j1 ; ++j)
+                    {
+                        B[j*r + i] = A[i*s + j];
+                    }
+                }
+            }
+        }
+    }
+
+
+    /**
+     * Tensoritulopinnan sovitus hiladataan z_ab = S(x_a, y_b) pienimmän
+     * neliösumman mielessä, S(x,y) = sum_ij C_ij Bx_i(x) By_j(y).
+     *
+     * Suunnittelumatriisi on Kroneckerin tulo Ax (x) Ay, joten ratkaisu on
+     * C = Ax^+ Z (Ay^+)^T: ensin sovitetaan jokainen y-sarake x-kannalla ja
+     * sitten tuloksen jokainen rivi y-kannalla. Tarvitaan vain kaksi 1D
+     * kaistamuotoista hajotelmaa, aika O(Nx Ny p + Mx Ny p + Mx My p), eikä
+     * (Nx Ny) x (Mx My) -matriisia muodosteta.
+     *
+     * @param kx x-suunnan kanta (Mx kantafunktiota)
+     * @param ky y-suunnan kanta (My kantafunktiota)
+     * @param x Hilan x-koordinaatit (nx kpl)
+     * @param nx x-koordinaattien määrä
+     * @param y Hilan y-koordinaatit (ny kpl)
+     * @param ny y-koordinaattien määrä
+     * @param Z Data nx x ny riveittäin, Z[a*ny + b] = z(x_a, y_b)
+     * @param C Kertoimet Mx x My riveittäin
+     * @param kunto Suurempi suuntien kuntoisuuslukujen arvioista
+     * @param saikeet Säikeiden määrä, 0 = laitteiston säikeet
+     * @param max_kunto Suurin hyväksyttävä kuntoisuusluku A^T A:lle (ks. sovita_sarakkeet)
+     * @return true jos sovitus epäonnistuu
+     */
+    inline bool sovita_pinta(const bspline_kanta &kx, const bspline_kanta &ky,
+                             const double *x, std::size_t nx, const double *y, std::size_t ny,
+                             const double *Z, std::vector<double> &C, double &kunto,
+                             unsigned saikeet = 0, double max_kunto = 1.0e12)
+    {
+        const std::size_t Mx = kx.maara();
+        const std::size_t My = ky.maara();
+        double kunto_y = 0.0;
+        std::vector<double> U;
+        std::vector<double> V;
+
+        // U = Ax^+ Z (Mx x ny)
+        if(sovita_sarakkeet(kx, x, nx, Z, ny, U, kunto, saikeet, max_kunto))
+        {
+            return true;
+        }
+        // C^T = Ay^+ U^T (My x Mx)
+        std::vector<double> Ut(ny * Mx);
+        transponoi(U.data(), Mx, ny, Ut.data());
+        bool virhe = sovita_sarakkeet(ky, y, ny, Ut.data(), Mx, V, kunto_y, saikeet, max_kunto);
+        kunto = std::max(kunto, kunto_y);
+        if(virhe)
+        {
+            return true;
+        }
+        C.resize(Mx * My);
+        transponoi(V.data(), My, Mx, C.data());
+        return false;
+    }
+
+
+    /**
+     * Tensoritulopinta S(x,y) = sum_ij C_ij Bx_i(x) By_j(y).
+     * Alueen [tx_0, tx_last] x [ty_0, ty_last] ulkopuolella S = 0.
+     */
+    class bspline_pinta
+    {
+    public:
+        /**
+         * @param kx x-suunnan kanta
+         * @param ky y-suunnan kanta
+         * @param C Kertoimet Mx x My riveittäin
+         */
+        bspline_pinta(const bspline_kanta &kx, const bspline_kanta &ky, const std::vector<double> &C)
+            : kx_(kx), ky_(ky), C_(C)
+        {
+            if(C.size() != static_cast<std::size_t>(kx.maara()) * ky.maara())
+            {
+                throw std::invalid_argument("bspline_pinta: kertoimien määrä ei vastaa kantoja");
+            }
+        }
+
+        /**
+         * Pinnan arvo yhdessä pisteessä, O(p^2).
+         */
+        double operator()(double x, double y) const
+        {
+            double Nx[bspline_kanta::max_aste + 1];
+            double Ny[bspline_kanta::max_aste + 1];
+            const int i0 = kx_.arvot(x, Nx);
+            const int j0 = ky_.arvot(y, Ny);
+            const int Mx = kx_.maara();
+            const int My = ky_.maara();
+            double s = 0.0;
+            for(int r = 0 ; r <= kx_.aste() ; ++r)
+            {
+                const int i = i0 + r;
+                if(i < 0 || i >= Mx || Nx[r] == 0.0) continue;
+                double t = 0.0;
+                for(int q = 0 ; q <= ky_.aste() ; ++q)
+                {
+                    const int j = j0 + q;
+                    if(j >= 0 && j < My) t += Ny[q] * C_[static_cast<std::size_t>(i)*My + j];
+                }
+                s += Nx[r] * t;
+            }
+            return s;
+        }
+
+        /**
+         * Laskee pinnan hilassa Z[a*ny + b] = S(x_a, y_b).
+         *
+         * y-kantafunktiot lasketaan kerran koko hilalle. Jokaiselle x-riville
+         * kerroinrivit yhdistetään ensin yhdeksi y-suuntaiseksi kerroinvektoriksi,
+         * O(p My), jolloin pistettä kohden jää O(p) työtä. Rivit jaetaan säikeille.
+         *
+         * @param saikeet Säikeiden määrä, 0 = laitteiston säikeet
+         */
+        void arvioi_hila(const double *x, std::size_t nx, const double *y, std::size_t ny,
+                         double *Z, unsigned saikeet = 0) const
+        {
+            const int px = kx_.aste();
+            const int py = ky_.aste();
+            const int Mx = kx_.maara();
+            const int My = ky_.maara();
+            std::vector<int> j0(ny);
+            std::vector<double> Ny(ny * (py + 1));
+            for(std::size_t b = 0 ; b < ny ; ++b)
+            {
+                // indeksit siirretään py:llä, jolloin kaikki kelpaavat apuvektoriin
+                j0[b] = ky_.arvot(y[b], &Ny[b * (py + 1)]) + py;
+            }
+
+            rinnakkain(nx, saikeet, std::max<std::size_t>(1, 4096 / (ny + 1)), 1, [&](std::size_t a0, std::size_t a1){
+                // apuvektorissa py nollaa kummassakin päässä
+                std::vector<double> rivi(My + 2*py);
+                double Nx[bspline_kanta::max_aste + 1];
+                for(std::size_t a = a0 ; a < a1 ; ++a)
+                {
+                    std::fill(rivi.begin(), rivi.end(), 0.0);
+                    const int i0 = kx_.arvot(x[a], Nx);
+                    for(int r = 0 ; r <= px ; ++r)
+                    {
+                        const int i = i0 + r;
+                        if(i < 0 || i >= Mx || Nx[r] == 0.0) continue;
+                        const double *Ci = &C_[static_cast<std::size_t>(i) * My];
+                        for(int j = 0 ; j < My ; ++j) rivi[j + py] += Nx[r] * Ci[j];
+                    }
+                    double *Za = Z + a * ny;
+                    for(std::size_t b = 0 ; b < ny ; ++b)
+                    {
+                        const double *Nb = &Ny[b * (py + 1)];
+                        const double *Rb = &rivi[j0[b]];
+                        double s = 0.0;
+                        for(int q = 0 ; q <= py ; ++q) s += Nb[q] * Rb[q];
+                        Za[b] = s;
+                    }
+                }
+            });
+        }
+
+    private:
+        bspline_kanta kx_;
+        bspline_kanta ky_;
+        std::vector<double> C_;
+    };
+
+
+    /**
+     * Symmetrinen positiivisesti definiitti kaistamatriisi ja sen Cholesky-hajotelma
+     * A = R^T R. Alkiot A(j, j+d), d = 0..h, talletetaan riveittäin kuten
+     * kaista_qr:n R. Hajotelma ja valikoiva käänteismatriisi maksavat O(M h^2).
+     */
+    class kaista_cholesky
+    {
+    public:
+        /**
+         * @param M Matriisin koko
+         * @param h Kaistan puoliskon leveys
+         */
+        kaista_cholesky(int M, int h) : M_(M), w_(h + 1), R_(static_cast<std::size_t>(M) * (h + 1), 0.0)
+        {
+        }
+
+        int maara(void) const { return M_; }
+
+        /** R:n alkio R(j, j+d). */
+        double r(int j, int d) const { return R_[static_cast<std::size_t>(j)*w_ + d]; }
+
+        /**
+         * Hajottaa matriisin A, joka annetaan samassa muodossa (leveys h+1).
+         * @return true jos A ei ole positiivisesti definiitti
+         */
+        bool hajota(const std::vector<double> &A)
+        {
+            R_ = A;
+            for(int j = 0 ; j < M_ ; ++j)
+            {
+                double *Rj = &R_[static_cast<std::size_t>(j)*w_];
+                // vähennetään yllä olevien rivien osuus: A(j, j+d) - sum_k R(k,j) R(k,j+d)
+                for(int k = std::max(0, j - w_ + 1) ; k < j ; ++k)
+                {
+                    const double *Rk = &R_[static_cast<std::size_t>(k)*w_];
+                    const double a = Rk[j - k];
+                    for(int d = 0 ; j - k + d < w_ ; ++d)
+                    {
+                        Rj[d] -= a * Rk[j - k + d];
+                    }
+                }
+                if(!(Rj[0] > 0.0))
+                {
+                    return true;
+                }
+                Rj[0] = std::sqrt(Rj[0]);
+                const double k = 1.0 / Rj[0];
+                for(int d = 1 ; d < w_ ; ++d)
+                {
+                    Rj[d] = (j + d < M_) ? Rj[d] * k : 0.0;
+                }
+            }
+            return false;
+        }
+
+        /**
+         * Ratkaisee A c = b paikallaan, O(M h).
+         */
+        void ratkaise(std::vector<double> &c) const
+        {
+            for(int j = 0 ; j < M_ ; ++j)
+            {
+                double s = c[j];
+                for(int d = 1 ; d < w_ && d <= j ; ++d)
+                {
+                    s -= r(j-d, d) * c[j-d];
+                }
+                c[j] = s / r(j,0);
+            }
+            for(int j = M_ - 1 ; j >= 0 ; --j)
+            {
+                double s = c[j];
+                for(int d = 1 ; d < w_ && j + d < M_ ; ++d)
+                {
+                    s -= r(j,d) * c[j+d];
+                }
+                c[j] = s / r(j,0);
+            }
+        }
+
+        /**
+         * Käänteismatriisin S = A^{-1} kaistan sisäiset alkiot S(j, j+d), d = 0..h,
+         * Takahashin rekursiolla: R S = R^{-T} on alakolmiomatriisi, jonka
+         * lävistäjä on 1/R_jj, joten
+         *
+         *   S(i,j) = (delta_ij / R_ii - sum_{k=i+1}^{i+h} R(i,k) S(k,j)) / R_ii,  j >= i,
+         *
+         * ja oikean puolen S(k,j) ovat aina kaistan sisällä. Aika O(M h^2)
+         * koko käänteismatriisin O(M^2 h):n sijaan.
+         *
+         * @param S Tulos samassa muodossa kuin A
+         */
+        void valikoiva_kaanteis(std::vector<double> &S) const
+        {
+            S.assign(R_.size(), 0.0);
+            // symmetrinen haku kaistasta
+            auto s = [&](int a, int b) { return (a <= b) ? S[static_cast<std::size_t>(a)*w_ + (b - a)]
+                                                          : S[static_cast<std::size_t>(b)*w_ + (a - b)]; };
+            for(int i = M_ - 1 ; i >= 0 ; --i)
+            {
+                const double rii = r(i,0);
+                for(int d = w_ - 1 ; d >= 0 ; --d)
+                {
+                    const int j = i + d;
+                    if(j >= M_)
+                    {
+                        continue;
+                    }
+                    double v = (d == 0) ? 1.0 / rii : 0.0;
+                    for(int e = 1 ; e < w_ && i + e < M_ ; ++e)
+                    {
+                        v -= r(i,e) * s(i + e, j);
+                    }
+                    S[static_cast<std::size_t>(i)*w_ + d] = v / rii;
+                }
+            }
+        }
+
+    private:
+        int M_;
+        int w_;
+        std::vector<double> R_;
+    };
+
+
+    /**
+     * Tasoitettu B-spline sovitus (P-spline): minimoidaan
+     *
+     *   ||A c - y||^2 + lambda ||D_k c||^2,
+     *
+     * missä D_k on kertoimien k:nnen kertaluvun erotusmatriisi. Normaaliyhtälöt
+     * (A^T A + lambda D_k^T D_k) c = A^T y ovat kaistamuotoisia (h = max(p, k)),
+     * joten A^T A ja A^T y kootaan kerran, O(N p^2), ja jokainen lambda
+     * ratkaistaan Cholesky-hajotelmalla ajassa O(M h^2).
+     *
+     * Tasoitusparametri valitaan yleistetyllä ristiinvalidoinnilla
+     *
+     *   GCV(lambda) = N ||A c - y||^2 / (N - tr H)^2,  H = A (A^T A + lambda P)^{-1} A^T,
+     *
+     * missä tr H = tr(S A^T A) tarvitsee käänteismatriisista S vain kaistan
+     * A^T A:n leveydeltä (kaista_cholesky::valikoiva_kaanteis). Yksi lambda
+     * maksaa siis O(N p + M h^2) ilman uudelleensovitusta tiheillä matriiseilla.
+     */
+    class bspline_tasoitus
+    {
+    public:
+        /**
+         * @param kanta B-spline kanta
+         * @param x Pisteiden x-koordinaatit
+         * @param y Pisteiden y-koordinaatit
+         * @param n Pisteiden määrä
+         * @param kertaluku Erotussakon kertaluku k (1..p+1 on tavallinen, oletus 2)
+         */
+        bspline_tasoitus(const bspline_kanta &kanta, const double *x, const double *y, std::size_t n, int kertaluku = 2)
+            : A_(suunnittelumatriisi(kanta, x, n)), y_(y, y + n), M_(kanta.maara()), p_(kanta.aste()),
+              h_(std::max(kanta.aste(), kertaluku))
+        {
+            if(kertaluku < 0 || kertaluku >= M_)
+            {
+                throw std::invalid_argument("bspline_tasoitus: virheellinen erotussakon kertaluku");
+            }
+            const int w = h_ + 1;
+            G_.assign(static_cast<std::size_t>(M_) * w, 0.0);
+            b_.assign(M_, 0.0);
+            for(std::size_t i = 0 ; i < n ; ++i)
+            {
+                const double *a = &A_.arvot[i * A_.leveys];
+                for(int r = 0 ; r < A_.leveys ; ++r)
+                {
+                    const int j = A_.alku[i] + r;
+                    if(j < 0 || j >= M_) continue;
+                    b_[j] += a[r] * y[i];
+                    for(int q = r ; q < A_.leveys && A_.alku[i] + q < M_ ; ++q)
+                    {
+                        G_[static_cast<std::size_t>(j)*w + (q - r)] += a[r] * a[q];
+                    }
+                }
+            }
+
+            // D_k:n rivit ovat binomikertoimia (-1)^(k-r) C(k,r)
+            std::vector<double> e(kertaluku + 1, 0.0);
+            e[0] = 1.0;
+            for(int k = 1 ; k <= kertaluku ; ++k)
+            {
+                for(int r = k ; r >= 1 ; --r) e[r] = e[r-1] - e[r];
+                e[0] = -e[0];
+            }
+            P_.assign(static_cast<std::size_t>(M_) * w, 0.0);
+            for(int i = 0 ; i + kertaluku < M_ ; ++i)
+            {
+                for(int r = 0 ; r <= kertaluku ; ++r)
+                {
+                    for(int q = r ; q <= kertaluku ; ++q)
+                    {
+                        P_[static_cast<std::size_t>(i + r)*w + (q - r)] += e[r] * e[q];
+                    }
+                }
+            }
+
+            // lambdan luonnollinen mittakaava tr(A^T A) / tr(P)
+            double g = 0.0;
+            double q = 0.0;
+            for(int j = 0 ; j < M_ ; ++j)
+            {
+                g += G_[static_cast<std::size_t>(j)*w];
+                q += P_[static_cast<std::size_t>(j)*w];
+            }
+            mittakaava_ = (q > 0.0) ? g / q : 1.0;
+        }
+
+        /** lambdan mittakaava tr(A^T A) / tr(D^T D), jonka ympäriltä valitse() hakee. */
+        double mittakaava(void) const { return mittakaava_; }
+
+        /**
+         * Sovittaa annetulla lambdalla.
+         *
+         * @param lambda Tasoitusparametri (>= 0)
+         * @param c Kertoimet
+         * @param jalki Vaikuttava vapausasteiden määrä tr H
+         * @param jaannos Jäännösneliösumma ||A c - y||^2
+         * @return true jos yhtälöryhmä on singulaarinen (esim. lambda = 0 ja
+         *         kantafunktiolla ei ole dataa)
+         */
+        bool sovita(double lambda, std::vector<double> &c, double &jalki, double &jaannos) const
+        {
+            const int w = h_ + 1;
+            std::vector<double> K(G_);
+            for(std::size_t i = 0 ; i < K.size() ; ++i) K[i] += lambda * P_[i];
+            kaista_cholesky L(M_, h_);
+            if(L.hajota(K))
+            {
+                jalki = jaannos = std::numeric_limits<double>::quiet_NaN();
+                return true;
+            }
+            c = b_;
+            L.ratkaise(c);
+
+            // tr H = sum_ij S_ij G_ij, G:n kaista on vain p leveä
+            std::vector<double> S;
+            L.valikoiva_kaanteis(S);
+            jalki = 0.0;
+            for(int j = 0 ; j < M_ ; ++j)
+            {
+                const std::size_t k = static_cast<std::size_t>(j)*w;
+                jalki += S[k] * G_[k];
+                for(int d = 1 ; d <= p_ && j + d < M_ ; ++d)
+                {
+                    jalki += 2.0 * S[k + d] * G_[k + d];
+                }
+            }
+
+            // jäännös suoraan datasta, O(N p)
+            jaannos = 0.0;
+            for(std::size_t i = 0 ; i < y_.size() ; ++i)
+            {
+                const double *a = &A_.arvot[i * A_.leveys];
+                double f = 0.0;
+                for(int r = 0 ; r < A_.leveys ; ++r)
+                {
+                    const int j = A_.alku[i] + r;
+                    if(j >= 0 && j < M_) f += a[r] * c[j];
+                }
+                jaannos += (f - y_[i]) * (f - y_[i]);
+            }
+            return false;
+        }
+
+        /**
+         * Yleistetty ristiinvalidointi GCV(lambda), ääretön jos sovitus epäonnistuu.
+         */
+        double gcv(double lambda) const
+        {
+            std::vector<double> c;
+            double jalki;
+            double jaannos;
+            return gcv(lambda, c, jalki, jaannos);
+        }
+
+        /**
+         * Valitsee lambdan minimoimalla GCV:n: ensin tasavälinen haku
+         * log10(lambda / mittakaava()) välillä [ala, yla], sitten kultaisen
+         * leikkauksen haku parhaan hilapisteen naapurivälillä.
+         *
+         * @param lambda Valittu tasoitusparametri
+         * @param c Sen kertoimet
+         * @param jalki Vaikuttava vapausasteiden määrä
+         * @param arvo GCV:n arvo
+         * @param ala Hakuvälin alaraja (log10, suhteessa mittakaavaan)
+         * @param yla Hakuvälin yläraja
+         * @param pisteet Hilapisteiden määrä
+         * @return true jos millään lambdalla ei saatu sovitusta
+         */
+        bool valitse(double &lambda, std::vector<double> &c, double &jalki, double &arvo,
+                     double ala = -8.0, double yla = 8.0, int pisteet = 33) const
+        {
+            pisteet = std::max(pisteet, 3);
+            const double h = (yla - ala) / (pisteet - 1);
+            auto f = [&](double u) { return gcv(mittakaava_ * std::pow(10.0, u)); };
+
+            int paras = -1;
+            double pienin = std::numeric_limits<double>::infinity();
+            for(int i = 0 ; i < pisteet ; ++i)
+            {
+                double v = f(ala + i*h);
+                if(v < pienin)
+                {
+                    pienin = v;
+                    paras = i;
+                }
+            }
+            if(paras < 0)
+            {
+                return true;
+            }
+
+            // kultainen leikkaus välillä [u_{i-1}, u_{i+1}]
+            const double g = 0.5 * (std::sqrt(5.0) - 1.0);
+            double a = ala + std::max(paras - 1, 0) * h;
+            double b = ala + std::min(paras + 1, pisteet - 1) * h;
+            double u1 = b - g*(b - a);
+            double u2 = a + g*(b - a);
+            double f1 = f(u1);
+            double f2 = f(u2);
+            while(b - a > 1.0e-3)
+            {
+                if(f1 < f2)
+                {
+                    b = u2; u2 = u1; f2 = f1;
+                    u1 = b - g*(b - a); f1 = f(u1);
+                }
+                else
+                {
+                    a = u1; u1 = u2; f1 = f2;
+                    u2 = a + g*(b - a); f2 = f(u2);
+                }
+            }
+            double u = ala + paras*h;
+            if(std::min(f1, f2) < pienin)
+            {
+                u = (f1 < f2) ? u1 : u2;
+            }
+            lambda = mittakaava_ * std::pow(10.0, u);
+            double jaannos;
+            arvo = gcv(lambda, c, jalki, jaannos);
+            return false;
+        }
+
+    private:
+        double gcv(double lambda, std::vector<double> &c, double &jalki, double &jaannos) const
+        {
+            const double n = static_cast<double>(y_.size());
+            if(sovita(lambda, c, jalki, jaannos) || !(jalki < n))
+            {
+                return std::numeric_limits<double>::infinity();
+            }
+            return n * jaannos / ((n - jalki) * (n - jalki));
+        }
+
+        kaistamatriisi A_;
+        std::vector<double> y_;
+        int M_;
+        int p_;
+        int h_;
+        std::vector<double> G_;     ///< A^T A kaistamuodossa (leveys h+1)
+        std::vector<double> P_;     ///< D^T D kaistamuodossa
+        std::vector<double> b_;     ///< A^T y
+        double mittakaava_;
+    };
+}
+
+#endif
@@ -0,0 +1,368 @@
+/**
+ * @file chebyshev.hpp
+ * @brief FYSA120 kaksiulotteinen Chebyshev-sijaismalli
+ * @author keijo.k.a.salonen@student.jyu.fi
+ *
+ * Sileä funktio f(x,y) suorakulmiossa korvataan tensoritulopolynomilla
+ *
+ *   p(x,y) = sum_{i,j=0}^{n} c_ij T_i(u(x)) T_j(v(y)),
+ *
+ * jonka kertoimet lasketaan (n+1)^2 näytteestä Chebyshevin solmuissa.
+ * Polynomi lasketaan Clenshaw'n rekursiolla: sarakkeittain ensin x-suunnassa
+ * kaikille j:ille ja sitten y-suunnassa lohkolle pisteitä kerralla
+ * (vektoroitava sisin silmukka).
+ *
+ * Virhearvio on kahden korkeimman asteen kertoimien itseisarvojen summa.
+ * Se on heuristinen arvio eikä taattu yläraja: se on katkaisuvirheen
+ * suuruusluokkaa vain, jos kertoimet vaimenevat geometrisesti. Siksi
+ * chebyshev_kokoa vertaa polynomia lisäksi tarkkaan arvoon
+ * tarkistuspisteissä ennen laatan hyväksymistä.
+ *
+ * chebyshev_kokoa jakaa kokonaislukuhilan laattoihin puolittamalla, kunnes
+ * jokaisessa laatassa virhearvio alittaa toleranssin. Liian pienet laatat,
+ * joissa näytteistys ei kannata, lasketaan suoraan tarkalla funktiolla.
+ */
+#ifndef FYSA120_CHEBYSHEV_HPP
+#define FYSA120_CHEBYSHEV_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+
+/**
+ * fysa120 nimiavaruus
+ */
+namespace fysa120
+{
+    /**
+     * Chebyshev-interpolantti suorakulmiossa [x0,x1] x [y0,y1].
+     */
+    class chebyshev_2d
+    {
+    public:
+        static const int max_aste = 64;
+
+        /**
+         * Chebyshevin (ensimmäisen lajin) solmu m = 0..n välillä [a,b].
+         */
+        static double solmu(int m, int n, double a, double b)
+        {
+            const double t = std::cos(M_PI * (m + 0.5) / (n + 1));
+            return 0.5*(a + b) + 0.5*(b - a)*t;
+        }
+
+        /**
+         * @param naytteet f(solmu(m), solmu(q)) riveittäin, naytteet[m*(n+1) + q]
+         * @param x0 x-välin alaraja
+         * @param x1 x-välin yläraja
+         * @param y0 y-välin alaraja
+         * @param y1 y-välin yläraja
+         * @param n Aste kumpaankin suuntaan
+         */
+        chebyshev_2d(const std::vector<double> &naytteet, double x0, double x1, double y0, double y1, int n)
+            : x0_(x0), x1_(x1), y0_(y0), y1_(y1), n_(n), c_(static_cast<std::size_t>(n + 1) * (n + 1), 0.0)
+        {
+            const int w = n + 1;
+            if(n < 1 || n > max_aste || naytteet.size() != c_.size() || !(x1 > x0) || !(y1 > y0))
+            {
+                throw std::invalid_argument("chebyshev_2d: virheellinen aste, väli tai näytteiden määrä");
+            }
+            // T_i(t_m) = cos(i pi (m + 1/2) / (n+1))
+            std::vector<double> T(static_cast<std::size_t>(w) * w);
+            for(int i = 0 ; i < w ; ++i)
+            {
+                for(int m = 0 ; m < w ; ++m)
+                {
+                    T[i*w + m] = std::cos(M_PI * i * (m + 0.5) / w);
+                }
+            }
+            // diskreetti kosinimuunnos kumpaankin suuntaan, O(n^3)
+            std::vector<double> B(c_.size(), 0.0);
+            for(int m = 0 ; m < w ; ++m)
+            {
+                for(int j = 0 ; j < w ; ++j)
+                {
+                    double s = 0.0;
+                    for(int q = 0 ; q < w ; ++q) s += naytteet[m*w + q] * T[j*w + q];
+                    B[m*w + j] = s * (j == 0 ? 1.0 : 2.0) / w;
+                }
+            }
+            for(int i = 0 ; i < w ; ++i)
+            {
+                for(int j = 0 ; j < w ; ++j)
+                {
+                    double s = 0.0;
+                    for(int m = 0 ; m < w ; ++m) s += T[i*w + m] * B[m*w + j];
+                    c_[i*w + j] = s * (i == 0 ? 1.0 : 2.0) / w;
+                }
+            }
+        }
+
+        int aste(void) const { return n_; }
+
+        /** Kerroin c_ij. */
+        double kerroin(int i, int j) const { return c_[static_cast<std::size_t>(i)*(n_ + 1) + j]; }
+
+        /**
+         * Katkaisuvirheen heuristinen arvio: sum |c_ij|, max(i,j) >= n-1.
+         * Ei ole yläraja, jos kertoimet eivät vaimene geometrisesti.
+         */
+        double virhearvio(void) const
+        {
+            double s = 0.0;
+            for(int i = 0 ; i <= n_ ; ++i)
+            {
+                for(int j = 0 ; j <= n_ ; ++j)
+                {
+                    if(std::max(i,j) >= n_ - 1) s += std::abs(kerroin(i,j));
+                }
+            }
+            return s;
+        }
+
+        /**
+         * Polynomin arvo yhdessä pisteessä, O(n^2).
+         */
+        double operator()(double x, double y) const
+        {
+            double d[max_aste + 1];
+            rivi(x, d);
+            const double v = kuvaa(y, y0_, y1_);
+            double b1 = 0.0;
+            double b2 = 0.0;
+            for(int j = n_ ; j >= 1 ; --j)
+            {
+                const double b0 = 2.0*v*b1 - b2 + d[j];
+                b2 = b1;
+                b1 = b0;
+            }
+            return v*b1 - b2 + d[0];
+        }
+
+        /**
+         * Laskee polynomin pisteissä (x, y[0..ny-1]), O(n^2 + n ny).
+         * @param z Tulokset
+         */
+        void arvioi_sarake(double x, const double *y, std::size_t ny, double *z) const
+        {
+            double d[max_aste + 1];
+            rivi(x, d);
+            double v[lohko];
+            double b1[lohko];
+            double b2[lohko];
+            for(std::size_t alku = 0 ; alku < ny ; alku += lohko)
+            {
+                const int L = static_cast<int>(std::min<std::size_t>(lohko, ny - alku));
+                for(int i = 0 ; i < L ; ++i)
+                {
+                    v[i] = kuvaa(y[alku + i], y0_, y1_);
+                    b1[i] = 0.0;
+                    b2[i] = 0.0;
+                }
+                for(int j = n_ ; j >= 1 ; --j)
+                {
+                    const double dj = d[j];
+                    for(int i = 0 ; i < L ; ++i)
+                    {
+                        const double b0 = 2.0*v[i]*b1[i] - b2[i] + dj;
+                        b2[i] = b1[i];
+                        b1[i] = b0;
+                    }
+                }
+                for(int i = 0 ; i < L ; ++i)
+                {
+                    z[alku + i] = v[i]*b1[i] - b2[i] + d[0];
+                }
+            }
+        }
+
+    private:
+        static const int lohko = 64;
+
+        static double kuvaa(double x, double a, double b)
+        {
+            return (2.0*x - a - b) / (b - a);
+        }
+
+        /**
+         * d_j = sum_i c_ij T_i(u(x)) kaikille j Clenshaw'n rekursiolla, O(n^2).
+         */
+        void rivi(double x, double *d) const
+        {
+            const int w = n_ + 1;
+            const double u = kuvaa(x, x0_, x1_);
+            double b1[max_aste + 1];
+            double b2[max_aste + 1];
+            std::fill(b1, b1 + w, 0.0);
+            std::fill(b2, b2 + w, 0.0);
+            for(int i = n_ ; i >= 1 ; --i)
+            {
+                const double *ci = &c_[static_cast<std::size_t>(i)*w];
+                for(int j = 0 ; j < w ; ++j)
+                {
+                    const double b0 = 2.0*u*b1[j] - b2[j] + ci[j];
+                    b2[j] = b1[j];
+                    b1[j] = b0;
+                }
+            }
+            for(int j = 0 ; j < w ; ++j)
+            {
+                d[j] = u*b1[j] - b2[j] + c_[j];
+            }
+        }
+
+        double x0_;
+        double x1_;
+        double y0_;
+        double y1_;
+        int n_;
+        std::vector<double> c_;     ///< c_ij riveittäin
+    };
+
+
+    /**
+     * chebyshev_kokoa:n tilastot.
+     */
+    struct chebyshev_tilastot
+    {
+        std::size_t laatat = 0;         ///< hyväksytyt polynomilaatat
+        std::size_t hylatyt = 0;        ///< puolitetut laatat
+        std::size_t kutsut = 0;         ///< tarkan funktion kutsut yhteensä
+        std::size_t tarkat = 0;         ///< suoraan tarkalla funktiolla lasketut alkiot
+        double suurin_arvio = 0.0;      ///< suurin hyväksytty suhteellinen virhearvio (heuristinen)
+    };
+
+
+    /**
+     * Laskee f(l,k) kaikille kokonaisluvuille 0 <= l < nl, 0 <= k < nk
+     * Chebyshev-laatoilla.
+     *
+     * Laatta hyväksytään, kun virhearvio on enintään tol * max|f| laatan
+     * näytteissä ja polynomi poikkeaa tarkasta arvosta enintään saman verran
+     * neljässä tarkistuspisteessä. Muuten laatta puolitetaan pidemmältä sivulta.
+     * Laatat, joissa on enintään 2 (n+1)^2 pistettä, lasketaan tarkasti.
+     *
+     * @param nl l-arvojen määrä
+     * @param nk k-arvojen määrä
+     * @param f Tarkka funktio f(l,k)
+     * @param kirjoita Kutsutaan kirjoita(l, k0, z, n): f(l, k0+i) = z[i], i < n
+     * @param tol Suhteellinen toleranssi
+     * @param aste Polynomin aste n kumpaankin suuntaan
+     * @param t Tilastot
+     */
+    template<typename F, typename K>
+    void chebyshev_kokoa(std::size_t nl, std::size_t nk, const F &f, const K &kirjoita,
+                         double tol, int aste, chebyshev_tilastot &t)
+    {
+        const std::size_t w = aste + 1;
+        std::vector<double> ky;
+        std::vector<double> z;
+
+        // laatta [l0,l1) x [k0,k1), pino rekursion sijaan
+        struct laatta { std::size_t l0, l1, k0, k1; };
+        std::vector<laatta> pino;
+        if(nl > 0 && nk > 0)
+        {
+            pino.push_back({0, nl, 0, nk});
+        }
+        while(!pino.empty())
+        {
+            const laatta L = pino.back();
+            pino.pop_back();
+            const std::size_t ml = L.l1 - L.l0;
+            const std::size_t mk = L.k1 - L.k0;
+
+            ky.resize(mk);
+            z.resize(mk);
+            for(std::size_t k = 0 ; k < mk ; ++k)
+            {
+                ky[k] = static_cast<double>(L.k0 + k);
+            }
+
+            if(ml * mk <= 2 * w * w || ml < 2 || mk < 2)
+            {
+                for(std::size_t l = L.l0 ; l < L.l1 ; ++l)
+                {
+                    for(std::size_t k = 0 ; k < mk ; ++k) z[k] = f(static_cast<double>(l), ky[k]);
+                    kirjoita(l, L.k0, z.data(), mk);
+                }
+                t.kutsut += ml * mk;
+                t.tarkat += ml * mk;
+                continue;
+            }
+
+            // näytteet Chebyshevin solmuissa välillä [l0, l1-1] x [k0, k1-1]
+            const double x0 = L.l0;
+            const double x1 = L.l1 - 1;
+            const double y0 = L.k0;
+            const double y1 = L.k1 - 1;
+            std::vector<double> naytteet(w * w);
+            double suurin = 0.0;
+            for(std::size_t m = 0 ; m < w ; ++m)
+            {
+                const double x = chebyshev_2d::solmu(m, aste, x0, x1);
+                for(std::size_t q = 0 ; q < w ; ++q)
+                {
+                    double v = f(x, chebyshev_2d::solmu(q, aste, y0, y1));
+                    naytteet[m*w + q] = v;
+                    suurin = std::max(suurin, std::abs(v));
+                }
+            }
+            t.kutsut += w * w;
+            chebyshev_2d p(naytteet, x0, x1, y0, y1, aste);
+            const double raja = tol * std::max(suurin, 1.0e-300);
+            const double arvio = p.virhearvio();
+
+            // tarkistuspisteet solmujen välissä
+            bool hyvaksytty = (arvio <= raja);
+            const std::size_t tl[2] = {L.l0 + ml/3, L.l0 + (2*ml)/3};
+            const std::size_t tk[2] = {L.k0 + mk/3, L.k0 + (2*mk)/3};
+            double tarkka[2][2];
+            for(int a = 0 ; a < 2 && hyvaksytty ; ++a)
+            {
+                for(int b = 0 ; b < 2 && hyvaksytty ; ++b)
+                {
+                    tarkka[a][b] = f(static_cast<double>(tl[a]), static_cast<double>(tk[b]));
+                    ++t.kutsut;
+                    hyvaksytty = std::abs(tarkka[a][b] - p(tl[a], tk[b])) <= raja;
+                }
+            }
+
+            if(!hyvaksytty)
+            {
+                ++t.hylatyt;
+                if(ml >= mk)
+                {
+                    pino.push_back({L.l0, L.l0 + ml/2, L.k0, L.k1});
+                    pino.push_back({L.l0 + ml/2, L.l1, L.k0, L.k1});
+                }
+                else
+                {
+                    pino.push_back({L.l0, L.l1, L.k0, L.k0 + mk/2});
+                    pino.push_back({L.l0, L.l1, L.k0 + mk/2, L.k1});
+                }
+                continue;
+            }
+
+            ++t.laatat;
+            t.suurin_arvio = std::max(t.suurin_arvio, arvio / std::max(suurin, 1.0e-300));
+            for(std::size_t l = L.l0 ; l < L.l1 ; ++l)
+            {
+                p.arvioi_sarake(static_cast<double>(l), ky.data(), mk, z.data());
+                // tarkistuspisteissä on jo tarkka arvo
+                for(int a = 0 ; a < 2 ; ++a)
+                {
+                    for(int b = 0 ; b < 2 ; ++b)
+                    {
+                        if(tl[a] == l) z[tk[b] - L.k0] = tarkka[a][b];
+                    }
+                }
+                kirjoita(l, L.k0, z.data(), mk);
+            }
+        }
+    }
+}
+
+#endif
@@ -6,9 +6,18 @@
  *
  * Funktio joka ratkaisee f(x)=0 mille tahansa jatkuvalle f(x):lle.
  *
+ * Kun ratkaistaan f(x; theta) = 0 hitaasti muuttuvalle parametrille theta,
+ * juurten_jatkaja seuraa juurihaaroja askel kerrallaan: edellinen juuri
+ * ennustetaan tangentilla (tai sekantilla) ja korjataan Newtonin
+ * iteraatiolla, jolloin yksi ratkaisu vaatii tyypillisesti 1-2 iteraatiota.
+ *
  */
 #include <iostream>
 #include <cmath>
+#include <functional>
+#include <vector>
+#include <utility>
+#include "profiling.hpp"
 
 /**
  * fysa120 nimiavaruus
@@ -53,6 +62,8 @@ namespace fysa120
      */
     bool findroot(const std::function<double(double)> &f,const double &a,const double &b, const double &eps, double &x )
     {
+        FYSA120_AJASTIN("findroot.bisection");
+        FYSA120_LASKURI_N("findroot.bisection.f_evals", 2);
         // Tarkistetaan, että nollakohta on olemassa etsityllä alueella
         double x1 = a;
         double x2 = b;
@@ -62,6 +73,8 @@ namespace fysa120
             double p = (x1+x2)/2.0;
             while(!(std::abs(f(p)) < eps))
             {
+                FYSA120_LASKURI_N("findroot.bisection.f_evals", 3);
+                FYSA120_LASKURI("findroot.bisection.iterations");
                 if(f(p)*f(x2) < 0)
                 {
                     x1 = p;
@@ -78,6 +91,7 @@ namespace fysa120
                     return true;
                 }
             }
+            FYSA120_LASKURI("findroot.bisection.f_evals");
             x = p;
             return false;
         }
@@ -97,6 +111,8 @@ namespace fysa120
     */
    bool findroot(const std::function<double(double)> &f, const std::function<double(double)> &fder,const double &a,const double &b, const double &eps, double &x )
    {
+       FYSA120_AJASTIN("findroot.newton");
+       FYSA120_LASKURI_N("findroot.newton.f_evals", 2);
        // Tarkistetaan, että nollakohta on olemassa etsityllä alueella
        double x1 = a;
        double x2 = b;
@@ -106,6 +122,9 @@ namespace fysa120
            double p = (x1+x2)/2.0;
            while(!(std::abs(f(p)) < eps))
            {
+               FYSA120_LASKURI_N("findroot.newton.f_evals", 2);
+               FYSA120_LASKURI("findroot.newton.fder_evals");
+               FYSA120_LASKURI("findroot.newton.iterations");
                p = p - f(p)/fder(p);
                // tarkistetaan ettei ajauduta rajojen ulkopuolelle
                if( p < a || p > b)
@@ -113,19 +132,253 @@ namespace fysa120
                    return true;
                }
            }
+           FYSA120_LASKURI("findroot.newton.f_evals");
            x = p;
            return false;
        }
        return true;
    }
+
+
+    /**
+     * Yksi jatkamismenetelmällä seurattava juurihaara x(theta).
+     */
+    struct juurihaara
+    {
+        enum tila_t
+        {
+            kaynnissa,      ///< haaraa seurataan
+            kaantopiste,    ///< haara kääntyy takaisin (f_x -> 0), ei jatkoa tähän suuntaan
+            tormays         ///< haara kohtasi toisen seuratun haaran
+        };
+
+        double x;           ///< juuri parametrin arvolla theta
+        double theta;
+        double fx;          ///< f_x juuressa, etumerkki säilyy haaralla
+        double dxdt;        ///< ennusteen kulmakerroin dx/dtheta
+        double h;           ///< seuraavan askeleen pituus
+        double x_ed;        ///< edellinen piste sekanttiennustetta varten
+        double theta_ed;
+        tila_t tila;
+        long ratkaisut;     ///< hyväksytyt askeleet
+        long iteraatiot;    ///< Newton-iteraatiot hyväksytyissä askelissa
+        long hylatyt;       ///< hylätyt askeleet
+    };
+
+
+    /**
+     * Seuraa yhtälön f(x; theta) = 0 juurihaaroja parametrin theta muuttuessa.
+     *
+     * Jokainen askel ennustaa juuren tangentilla dx/dtheta = -f_theta / f_x,
+     * tai sekantilla kahdesta edellisestä pisteestä, jos f_theta:aa ei anneta,
+     * ja korjaa sen Newtonin iteraatiolla kiinteällä theta:lla. Askel
+     * hyväksytään, kun korjaus suppenee enintään max_iter iteraatiolla ja f_x:n
+     * etumerkki säilyy; etumerkin vaihtuminen tarkoittaa, että askel on
+     * hypännyt kääntöpisteen yli tai naapurihaaralle. Askelpituus kaksinkertaistuu
+     * nopean suppenemisen jälkeen ja puolittuu hylätyn askeleen jälkeen.
+     *
+     * Kun askel kutistuu alle h_min:n, haara pysäytetään: jos toinen haara
+     * on lähellä, kyseessä on törmäys (kaksi juurta yhtyy), muuten kääntöpiste.
+     */
+    class juurten_jatkaja
+    {
+    public:
+        typedef std::function<double(double,double)> funktio;    ///< g(x, theta)
+
+        /**
+         * @param f funktio f(x, theta)
+         * @param fx osittaisderivaatta f_x(x, theta)
+         * @param ft osittaisderivaatta f_theta(x, theta), tyhjä = sekanttiennuste
+         * @param eps juuren tarkkuus |f| < eps, kuten findroot
+         * @param h_min pienin sallittu askel ennen haaran pysäyttämistä
+         * @param h_max suurin sallittu askel
+         * @param tormays suhteellinen etäisyys, jota lähempänä haarat katsotaan samaksi
+         */
+        juurten_jatkaja(funktio f, funktio fx, funktio ft, double eps,
+                        double h_min = 1.0e-10, double h_max = HUGE_VAL, double tormays = 1.0e-3)
+            : f_(std::move(f)), fx_(std::move(fx)), ft_(std::move(ft)), eps_(eps), h_min_(h_min), h_max_(h_max), tormays_(tormays), max_iter_(6)
+        {
+        }
+
+        /**
+         * Aloittaa uuden haaran pisteestä x0 (korjataan Newtonilla juureksi).
+         * @return true jos x0:sta ei löydy juurta
+         */
+        bool lisaa_haara(double x0, double theta0)
+        {
+            juurihaara b;
+            int iter;
+            if(korjaa(x0, theta0, iter, b.fx))
+            {
+                return true;
+            }
+            b.x = b.x_ed = x0;
+            b.theta = b.theta_ed = theta0;
+            b.dxdt = ft_ ? -ft_(x0, theta0) / b.fx : 0.0;
+            b.h = h_max_;
+            b.tila = juurihaara::kaynnissa;
+            b.ratkaisut = 0;
+            b.iteraatiot = 0;
+            b.hylatyt = 0;
+            haarat_.push_back(b);
+            return false;
+        }
+
+        /**
+         * Siirtää kaikki käynnissä olevat haarat parametrin arvoon theta.
+         * @return true jos jokin haara pysähtyi
+         */
+        bool siirra(double theta)
+        {
+            std::vector<std::size_t> pysahtyneet;
+            for(std::size_t i = 0 ; i < haarat_.size() ; ++i)
+            {
+                if(haarat_[i].tila == juurihaara::kaynnissa && askella(haarat_[i], theta))
+                {
+                    pysahtyneet.push_back(i);
+                }
+            }
+            // haara, joka on päätynyt toisen haaran juureen, on hypännyt sille
+            for(std::size_t i = 0 ; i < haarat_.size() ; ++i)
+            {
+                for(std::size_t j = 0 ; j < i ; ++j)
+                {
+                    juurihaara &a = haarat_[j];
+                    juurihaara &b = haarat_[i];
+                    if(a.tila == juurihaara::kaynnissa && b.tila == juurihaara::kaynnissa
+                       && lahella(a.x, b.x))
+                    {
+                        b.tila = juurihaara::tormays;
+                        pysahtyneet.push_back(i);
+                    }
+                }
+            }
+            // kääntöpisteessä pysähtynyt haara törmäsi, jos toinen haara on samassa kohdassa
+            for(std::size_t i : pysahtyneet)
+            {
+                for(std::size_t j = 0 ; j < haarat_.size() ; ++j)
+                {
+                    if(j != i && haarat_[i].tila == juurihaara::kaantopiste && lahella(haarat_[i].x, haarat_[j].x))
+                    {
+                        haarat_[i].tila = juurihaara::tormays;
+                    }
+                }
+            }
+            return !pysahtyneet.empty();
+        }
+
+        const std::vector<juurihaara> &haarat(void) const { return haarat_; }
+
+    private:
+        bool lahella(double a, double b) const
+        {
+            return std::abs(a - b) < tormays_ * (1.0 + std::abs(a));
+        }
+
+        /**
+         * Newtonin korjaus kiinteällä theta:lla.
+         * @param fx f_x löydetyssä juuressa
+         * @return true jos ei suppene max_iter_ iteraatiolla
+         */
+        bool korjaa(double &x, double theta, int &iter, double &fx) const
+        {
+            for(iter = 0 ; ; ++iter)
+            {
+                FYSA120_LASKURI("continuation.f_evals");
+                double v = f_(x, theta);
+                if(std::abs(v) < eps_)
+                {
+                    FYSA120_LASKURI("continuation.fx_evals");
+                    fx = fx_(x, theta);
+                    return !(fx != 0.0);
+                }
+                if(iter == max_iter_)
+                {
+                    return true;
+                }
+                FYSA120_LASKURI("continuation.fx_evals");
+                double d = fx_(x, theta);
+                if(!(d != 0.0) || !std::isfinite(v))
+                {
+                    return true;
+                }
+                x -= v / d;
+            }
+        }
+
+        /**
+         * Siirtää yhden haaran parametrin arvoon kohde mukautuvin askelin.
+         * @return true jos haara pysähtyi
+         */
+        bool askella(juurihaara &b, double kohde)
+        {
+            while(b.theta != kohde)
+            {
+                const double loput = kohde - b.theta;
+                const bool viimeinen = std::abs(loput) <= b.h;
+                const double h = viimeinen ? loput : std::copysign(b.h, loput);
+                const double t = viimeinen ? kohde : b.theta + h;
+
+                // ennuste ja korjaus
+                double x = b.x + h * b.dxdt;
+                double fx;
+                int iter;
+                if(korjaa(x, t, iter, fx) || (fx > 0.0) != (b.fx > 0.0))
+                {
+                    ++b.hylatyt;
+                    FYSA120_LASKURI("continuation.rejected");
+                    b.h = 0.5 * std::abs(h);
+                    if(b.h < h_min_)
+                    {
+                        b.tila = juurihaara::kaantopiste;
+                        return true;
+                    }
+                    continue;
+                }
+
+                b.x_ed = b.x;
+                b.theta_ed = b.theta;
+                b.x = x;
+                b.theta = t;
+                b.fx = fx;
+                b.dxdt = ft_ ? -ft_(x, t) / fx : (b.x - b.x_ed) / (b.theta - b.theta_ed);
+                ++b.ratkaisut;
+                b.iteraatiot += iter;
+                FYSA120_HISTOGRAMMI("continuation.iterations", iter);
+
+                // viimeinen (lyhennetty) askel ei kerro askelpituudesta
+                if(iter <= 2 && !viimeinen)
+                {
+                    b.h = std::min(2.0 * b.h, h_max_);
+                }
+                else if(iter >= 4)
+                {
+                    b.h = 0.5 * std::abs(h);
+                }
+            }
+            return false;
+        }
+
+        funktio f_;
+        funktio fx_;
+        funktio ft_;
+        double eps_;
+        double h_min_;
+        double h_max_;
+        double tormays_;
+        int max_iter_;
+        std::vector<juurihaara> haarat_;
+    };
 	
 }
 
+#ifndef FYSA120_NO_MAIN
 /**
  * Pääohjelma testaamista varten
  */
 int main(void)
 {
+    FYSA120_PROFIILI("ex1_2");
     std::cout << "FYSA120 Exercise1_2" << std::endl;
     std::cout << "f(x) = sin(x)(x^2+2x)" << std::endl;
     std::cout << "f'(x) = cos(x)(x^2+2x)+sin(x)(2x+2)" << std::endl;
@@ -151,7 +404,33 @@ int main(void)
     std::cout << "4a: x = " << x << " f(x) = " << fysa120::f(x) << std::endl;
     fysa120::findroot(fysa120::f, fysa120::fder, 6.0, 7.0, 0.00001, x);
     std::cout << "4b: x = " << x << " f(x) = " << fysa120::f(x) << std::endl;
+
+    // jatkaminen: f(x) - theta = 0, theta = 0.1 ... 2 tuhannella askeleella.
+    // x = 0 on kaksinkertainen juuri, joten aloitetaan sen molemmin puolin
+    // syntyneistä haaroista; vasen niistä yhtyy x = -2:sta lähtevään haaraan.
+    fysa120::juurten_jatkaja jatkaja(
+        [](double x, double theta) { return fysa120::f(x) - theta; },
+        [](double x, double) { return fysa120::fder(x); },
+        [](double, double) { return -1.0; },
+        0.00001);
+    for(double x0 : {-2.0, -0.3, 0.3, M_PI, 2*M_PI})
+    {
+        jatkaja.lisaa_haara(x0, 0.1);
+    }
+    const int askeleet = 2000;
+    for(int i = 1 ; i <= askeleet ; ++i)
+    {
+        jatkaja.siirra(0.1 + 1.9 * i / askeleet);
+    }
+    const char *tilat[] = {"käynnissä", "kääntöpiste", "törmäys"};
+    for(const auto &b : jatkaja.haarat())
+    {
+        std::cout << "haara: theta = " << b.theta << " x = " << b.x << " (" << tilat[b.tila] << "), "
+                  << b.ratkaisut << " askelta, " << (b.ratkaisut ? 1.0*b.iteraatiot/b.ratkaisut : 0.0)
+                  << " iteraatiota/askel, " << b.hylatyt << " hylättyä" << std::endl;
+    }
     
     return 0;
 }
+#endif
 
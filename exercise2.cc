@@ -8,7 +8,16 @@
  * 
  * @note
  * 
- * clang++ -std=c++11 exercise2.cc -o ex2
+ * clang++ -std=c++11 -pthread exercise2.cc -o ex2
+ *
+ * run_simulation kutsuu jokaiselle jonosta poistetulle tapahtumalle annettuja
+ * havainnoijia. Valmiit havainnoijat (momentit, prosessilaskuri,
+ * odotushistogrammi, lapaisy) käyttävät vakiomäärän muistia tapahtumien
+ * määrästä riippumatta, ja rinnakkaisten toistojen havainnoijat voi yhdistää
+ * yhdista():lla ilman toista läpikäyntiä.
+ *
+ * rinnakkainen_simulaatio jakaa prosessit loogisiin prosesseihin (LP), joilla
+ * on oma jono ja oma säie, ja synkronoi ne konservatiivisesti ennakkoikkunoilla.
  *
  */
 #include <iostream>
@@ -17,6 +26,18 @@
 #include <vector>
 #include <cmath>
 #include <queue>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include "profiling.hpp"
 
 /**
  * fysa120 nimiavaruus
@@ -55,9 +76,12 @@ namespace fysa120
      *
      * @param events Vektori johon tallenetaan tapahtumat
      * @param n Luotavien tapahtumien lukumäärä
+     * @param prosesseja Prosessien määrä, process_number = 0 ... prosesseja-1
      */
-    void generate_events(std::vector<event> &events, std::size_t n)
+    void generate_events(std::vector<event> &events, std::size_t n, int prosesseja = 13)
     {
+        FYSA120_AJASTIN("generate_events");
+        FYSA120_LASKURI_N("generate_events.events", n);
         double k = 0.1;
         double t;       ///< queue_time
         double tx;      ///< execution_time
@@ -70,7 +94,7 @@ namespace fysa120
         
         std::uniform_real_distribution<double> unif_dist_10(0,10); 
         std::uniform_real_distribution<double> unif_dist_1(0,1);
-        std::uniform_int_distribution<int> unif_int_dist(0,12);
+        std::uniform_int_distribution<int> unif_int_dist(0,prosesseja-1);
 
         auto random_t = std::bind(unif_dist_10, gena);
         auto random_r = std::bind(unif_dist_1, genb);
@@ -111,6 +135,8 @@ namespace fysa120
     */
     void insert_events_priority_queue(std::priority_queue<event> &queue, std::vector<event> &events)
     {
+        FYSA120_AJASTIN("queue.insert");
+        FYSA120_LASKURI_N("queue.push", events.size());
         for(auto e : events)
         {
             queue.push(e);
@@ -118,28 +144,685 @@ namespace fysa120
     }
     
     
+    /**
+     * Rajapinta, jota run_simulation kutsuu jokaiselle suoritetulle tapahtumalle.
+     */
+    class havainnoija
+    {
+    public:
+        virtual ~havainnoija() {}
+
+        /**
+         * @param e Jonosta poistettu tapahtuma (suoritusajan mukaan järjestyksessä)
+         */
+        virtual void havaitse(const event &e) = 0;
+    };
+
+
+    /**
+     * Tulostaa jokaisen tapahtuman virtaan.
+     */
+    class tulostin : public havainnoija
+    {
+    public:
+        explicit tulostin(std::ostream &os) : os_(os) {}
+
+        void havaitse(const event &e)
+        {
+            os_ << e << std::endl;
+        }
+
+    private:
+        std::ostream &os_;
+    };
+
+
+    /**
+     * Juoksevat momentit Welfordin algoritmilla. Kaksi tilaa yhdistetään
+     * Chanin kaavalla, joten rinnakkaisten toistojen tulokset ovat samat kuin
+     * yhdellä läpikäynnillä (pyöristysvirheitä lukuun ottamatta).
+     */
+    struct momentit
+    {
+        std::uint64_t n = 0;
+        double ka = 0.0;        ///< keskiarvo
+        double m2 = 0.0;        ///< poikkeamien neliösumma
+        double pienin = std::numeric_limits<double>::infinity();
+        double suurin = -std::numeric_limits<double>::infinity();
+
+        void lisaa(double x)
+        {
+            ++n;
+            double d = x - ka;
+            ka += d / n;
+            m2 += d * (x - ka);
+            pienin = std::min(pienin, x);
+            suurin = std::max(suurin, x);
+        }
+
+        void yhdista(const momentit &o)
+        {
+            if(o.n == 0)
+            {
+                return;
+            }
+            const double na = static_cast<double>(n);
+            const double nb = static_cast<double>(o.n);
+            const double d = o.ka - ka;
+            n += o.n;
+            ka += d * nb / n;
+            m2 += o.m2 + d * d * na * nb / n;
+            pienin = std::min(pienin, o.pienin);
+            suurin = std::max(suurin, o.suurin);
+        }
+
+        /** Otosvarianssi. */
+        double varianssi(void) const { return (n > 1) ? m2 / (n - 1) : 0.0; }
+    };
+
+
+    /**
+     * Odotusajan (execution_time - queue_time) ja suoritusten välisen ajan momentit.
+     */
+    class momentti_havainnoija : public havainnoija
+    {
+    public:
+        momentti_havainnoija() : edellinen_(std::numeric_limits<double>::quiet_NaN()) {}
+
+        void havaitse(const event &e)
+        {
+            odotus_.lisaa(e.execution_time - e.queue_time);
+            if(edellinen_ == edellinen_)
+            {
+                vali_.lisaa(e.execution_time - edellinen_);
+            }
+            edellinen_ = e.execution_time;
+        }
+
+        void yhdista(const momentti_havainnoija &o)
+        {
+            odotus_.yhdista(o.odotus_);
+            vali_.yhdista(o.vali_);
+        }
+
+        const momentit &odotus(void) const { return odotus_; }
+        const momentit &vali(void) const { return vali_; }
+
+    private:
+        momentit odotus_;
+        momentit vali_;
+        double edellinen_;  ///< edellisen tapahtuman suoritusaika, NaN ennen ensimmäistä
+    };
+
+
+    /**
+     * Tapahtumien määrä prosesseittain ja niiden suoritusnopeus
+     * (tapahtumia aikayksikössä havaitulla aikavälillä). Muistia kuluu
+     * prosessien määrän verran.
+     */
+    class prosessilaskuri : public havainnoija
+    {
+    public:
+        prosessilaskuri() : ensimmainen_(std::numeric_limits<double>::infinity()),
+                            viimeinen_(-std::numeric_limits<double>::infinity()), aiempi_kesto_(0.0)
+        {
+        }
+
+        void havaitse(const event &e)
+        {
+            if(e.process_number < 0)
+            {
+                throw std::invalid_argument("prosessilaskuri: negatiivinen prosessin numero");
+            }
+            if(static_cast<std::size_t>(e.process_number) >= lkm_.size())
+            {
+                lkm_.resize(e.process_number + 1, 0);
+            }
+            ++lkm_[e.process_number];
+            ensimmainen_ = std::min(ensimmainen_, e.execution_time);
+            viimeinen_ = std::max(viimeinen_, e.execution_time);
+        }
+
+        /**
+         * Yhdistää toisen toiston: määrät summataan ja havaitut ajat lasketaan yhteen.
+         */
+        void yhdista(const prosessilaskuri &o)
+        {
+            lisaa_maarat(o);
+            aiempi_kesto_ += o.kesto();
+        }
+
+        /**
+         * Yhdistää saman ajon toisen osan (esim. rinnakkaisen simulaation LP:n):
+         * määrät summataan, ja havaittu aikaväli on osien aikavälien yhdiste,
+         * koska osat kattavat saman ajanjakson.
+         */
+        void yhdista_osa(const prosessilaskuri &o)
+        {
+            lisaa_maarat(o);
+            ensimmainen_ = std::min(ensimmainen_, o.ensimmainen_);
+            viimeinen_ = std::max(viimeinen_, o.viimeinen_);
+            aiempi_kesto_ += o.aiempi_kesto_;
+        }
+
+        std::size_t prosesseja(void) const { return lkm_.size(); }
+        std::uint64_t maara(std::size_t p) const { return p < lkm_.size() ? lkm_[p] : 0; }
+
+        /** Havaittu aika: oma aikaväli ja yhdistettyjen toistojen ajat. */
+        double kesto(void) const
+        {
+            return aiempi_kesto_ + (viimeinen_ > ensimmainen_ ? viimeinen_ - ensimmainen_ : 0.0);
+        }
+
+        /** Prosessin p tapahtumia aikayksikössä. */
+        double nopeus(std::size_t p) const
+        {
+            double t = kesto();
+            return (t > 0.0) ? maara(p) / t : 0.0;
+        }
+
+    private:
+        void lisaa_maarat(const prosessilaskuri &o)
+        {
+            if(o.lkm_.size() > lkm_.size())
+            {
+                lkm_.resize(o.lkm_.size(), 0);
+            }
+            for(std::size_t i = 0 ; i < o.lkm_.size() ; ++i)
+            {
+                lkm_[i] += o.lkm_[i];
+            }
+        }
+
+        std::vector<std::uint64_t> lkm_;
+        double ensimmainen_;
+        double viimeinen_;
+        double aiempi_kesto_;
+    };
+
+
+    /**
+     * Kiinteävälinen histogrammi. Välin [alku, loppu) ulkopuoliset arvot
+     * lasketaan ala- ja ylivuotolokeroihin. Vain samalla jaolla tehdyt
+     * histogrammit voi yhdistää.
+     */
+    class histogrammi
+    {
+    public:
+        histogrammi(double alku, double loppu, std::size_t lokerot)
+            : alku_(alku), loppu_(loppu), lokerot_(lokerot, 0), ali_(0), yli_(0)
+        {
+            if(!(loppu > alku) || lokerot == 0)
+            {
+                throw std::invalid_argument("histogrammi: virheellinen jako");
+            }
+        }
+
+        void lisaa(double x)
+        {
+            if(x < alku_)
+            {
+                ++ali_;
+            }
+            else if(x >= loppu_)
+            {
+                ++yli_;
+            }
+            else
+            {
+                std::size_t i = static_cast<std::size_t>((x - alku_) / leveys());
+                ++lokerot_[std::min(i, lokerot_.size() - 1)];
+            }
+        }
+
+        void yhdista(const histogrammi &o)
+        {
+            if(o.alku_ != alku_ || o.loppu_ != loppu_ || o.lokerot_.size() != lokerot_.size())
+            {
+                throw std::invalid_argument("histogrammi: eri jako");
+            }
+            for(std::size_t i = 0 ; i < lokerot_.size() ; ++i)
+            {
+                lokerot_[i] += o.lokerot_[i];
+            }
+            ali_ += o.ali_;
+            yli_ += o.yli_;
+        }
+
+        double alku(void) const { return alku_; }
+        double leveys(void) const { return (loppu_ - alku_) / lokerot_.size(); }
+        std::size_t koko(void) const { return lokerot_.size(); }
+        std::uint64_t operator[](std::size_t i) const { return lokerot_[i]; }
+        std::uint64_t alivuoto(void) const { return ali_; }
+        std::uint64_t ylivuoto(void) const { return yli_; }
+
+    private:
+        double alku_;
+        double loppu_;
+        std::vector<std::uint64_t> lokerot_;
+        std::uint64_t ali_;
+        std::uint64_t yli_;
+    };
+
+
+    /**
+     * Odotusaikojen histogrammi.
+     */
+    class odotushistogrammi : public havainnoija
+    {
+    public:
+        odotushistogrammi(double loppu, std::size_t lokerot) : h_(0.0, loppu, lokerot) {}
+
+        void havaitse(const event &e)
+        {
+            h_.lisaa(e.execution_time - e.queue_time);
+        }
+
+        void yhdista(const odotushistogrammi &o) { h_.yhdista(o.h_); }
+
+        const histogrammi &jakauma(void) const { return h_; }
+
+    private:
+        histogrammi h_;
+    };
+
+
+    /**
+     * Läpäisy: suoritettujen tapahtumien määrä suoritusajan lokeroissa.
+     */
+    class lapaisy : public havainnoija
+    {
+    public:
+        lapaisy(double alku, double loppu, std::size_t lokerot) : h_(alku, loppu, lokerot) {}
+
+        void havaitse(const event &e)
+        {
+            h_.lisaa(e.execution_time);
+        }
+
+        void yhdista(const lapaisy &o) { h_.yhdista(o.h_); }
+
+        const histogrammi &lokerot(void) const { return h_; }
+
+        /** Tapahtumia aikayksikössä lokerossa i. */
+        double nopeus(std::size_t i) const { return h_[i] / h_.leveys(); }
+
+    private:
+        histogrammi h_;
+    };
+
+
     /**
     * Simuloidaan jonossa olevien tapahtumien suorittamista.
     *
     * @param q Prioriteettijono jossa on tapahtumat
+    * @param havainnoijat Kutsutaan jokaiselle poistetulle tapahtumalle annetussa järjestyksessä
     */
-    void run_simulation(std::priority_queue<event> &q)
+    void run_simulation(std::priority_queue<event> &q, const std::vector<havainnoija*> &havainnoijat)
     {
+        FYSA120_AJASTIN("run_simulation");
+        FYSA120_HISTOGRAMMI("queue.size_at_start", q.size());
         while(!q.empty())
         {
-            std::cout << q.top() << std::endl;
+            FYSA120_LASKURI("queue.pop");
+            for(auto h : havainnoijat)
+            {
+                h->havaitse(q.top());
+            }
             q.pop(); ///< poistetaan jonon ylin elementti
         }
     }
 
+
+    /**
+    * Simuloidaan jonossa olevien tapahtumien suorittamista ja tulostetaan tapahtumat.
+    *
+    * @param q Prioriteettijono jossa on tapahtumat
+    */
+    void run_simulation(std::priority_queue<event> &q)
+    {
+        tulostin t(std::cout);
+        run_simulation(q, {&t});
+    }
+
+
+    /**
+     * Uudelleenkäytettävä säikeiden puomi (C++11:ssä ei ole std::barrier).
+     */
+    class puomi
+    {
+    public:
+        explicit puomi(std::size_t n) : n_(n), odottaa_(0), sukupolvi_(0) {}
+
+        /**
+         * Odottaa, kunnes kaikki n säiettä ovat kutsuneet odota():a.
+         */
+        void odota(void)
+        {
+            std::unique_lock<std::mutex> lukko(m_);
+            const std::size_t s = sukupolvi_;
+            if(++odottaa_ == n_)
+            {
+                odottaa_ = 0;
+                ++sukupolvi_;
+                cv_.notify_all();
+            }
+            else
+            {
+                cv_.wait(lukko, [&]{ return s != sukupolvi_; });
+            }
+        }
+
+    private:
+        std::mutex m_;
+        std::condition_variable cv_;
+        std::size_t n_;
+        std::size_t odottaa_;
+        std::size_t sukupolvi_;
+    };
+
+
+    /**
+     * Rinnakkainen diskreetin tapahtuman simulaatio.
+     *
+     * Tapahtumat jaetaan loogisiin prosesseihin (LP) prosessin numeron
+     * (process_number mod LP:iden määrä) tai annetun jakofunktion mukaan.
+     * Jokaisella LP:llä on oma prioriteettijono ja oma säie.
+     *
+     * Synkronointi on konservatiivinen: kaikki LP:t suorittavat ikkunan
+     * [T, T + ennakko) tapahtumat, missä T on pienin jäljellä oleva
+     * suoritusaika kaikissa LP:issä, ja kohtaavat sitten puomilla. Käsittelijä
+     * voi luoda uusia tapahtumia; toiselle LP:lle menevän tapahtuman on oltava
+     * vähintään ennakon verran luojaansa myöhemmin, joten se kuuluu
+     * myöhempään ikkunaan eikä peruutuksia tarvita. Uudet tapahtumat toimitetaan
+     * vastaanottajan jonoon ikkunoiden välissä.
+     *
+     * Jokainen LP suorittaa omat tapahtumansa samassa järjestyksessä kuin
+     * peräkkäinen run_simulation, joten prosessikohtaiset suureet ovat samat.
+     * LP-kohtaiset havainnoijat yhdistetään lopuksi (prosessilaskuri::yhdista_osa,
+     * histogrammit ja odotusajan momentit yhdista():lla). Koko simulaation
+     * suoritusjärjestyksestä riippuvat havainnoijat (esim. momentti_havainnoija,
+     * jonka vali on peräkkäisten suoritusten väli) annetaan erikseen: niille
+     * LP:iden ikkunan tapahtumat lomitetaan suoritusajan mukaan ikkunoiden
+     * välissä, joten ne näkevät saman järjestyksen kuin peräkkäinen ajo.
+     * Lomitus tehdään yhdessä säikeessä ja vaatii ikkunan tapahtumien verran muistia.
+     */
+    class rinnakkainen_simulaatio
+    {
+    public:
+        typedef std::function<std::size_t(const event &)> jako_t;
+        typedef std::function<void(const event &, std::vector<event> &)> kasittelija_t;
+
+        /**
+         * @param lpt LP:iden (ja säikeiden) määrä
+         * @param jako Tapahtuman LP, tyhjä = process_number mod lpt
+         */
+        explicit rinnakkainen_simulaatio(std::size_t lpt, const jako_t &jako = jako_t()) : jako_(jako)
+        {
+            if(lpt == 0)
+            {
+                throw std::invalid_argument("rinnakkainen_simulaatio: LP:itä on oltava vähintään yksi");
+            }
+            for(std::size_t i = 0 ; i < lpt ; ++i)
+            {
+                lp_.emplace_back(new lp_tila());
+            }
+        }
+
+        std::size_t lpt(void) const { return lp_.size(); }
+
+        /**
+         * LP, jolle tapahtuma kuuluu.
+         */
+        std::size_t lp(const event &e) const
+        {
+            return (jako_ ? jako_(e) : static_cast<std::size_t>(e.process_number)) % lp_.size();
+        }
+
+        /**
+         * Lisää alkutapahtumat LP:ille. Jonot muodostetaan säikeissä aja():n alussa.
+         */
+        void lisaa(const std::vector<event> &events)
+        {
+            for(const auto &e : events)
+            {
+                lp_[lp(e)]->alku.push_back(e);
+            }
+        }
+
+        /**
+         * Suorittaa kaikki tapahtumat.
+         *
+         * @param havainnoijat havainnoijat[i] kutsutaan LP:n i tapahtumille (lpt() kpl)
+         * @param jarjestetyt Kutsutaan kaikille tapahtumille suoritusajan mukaan järjestyksessä
+         * @param kasittelija Kutsutaan jokaiselle tapahtumalle; voi lisätä uusia tapahtumia
+         * @param ennakko Ikkunan leveys: toiselle LP:lle luodun tapahtuman vähimmäisviive
+         * @return Ikkunoiden määrä
+         *
+         * Havainnoijan tai käsittelijän heittämä poikkeus pysäyttää kaikki LP:t
+         * seuraavalla puomilla, ja se heitetään uudelleen, kun säikeet on yhdistetty.
+         */
+        std::size_t aja(const std::vector<std::vector<havainnoija*>> &havainnoijat,
+                        const std::vector<havainnoija*> &jarjestetyt = std::vector<havainnoija*>(),
+                        const kasittelija_t &kasittelija = kasittelija_t(),
+                        double ennakko = 1.0)
+        {
+            FYSA120_AJASTIN("pdes.run");
+            const std::size_t n = lp_.size();
+            if(havainnoijat.size() != n || !(ennakko > 0.0))
+            {
+                throw std::invalid_argument("rinnakkainen_simulaatio: virheellinen havainnoijien määrä tai ennakko");
+            }
+            puomi p(n);
+            std::vector<double> minimit(n);
+            std::atomic<bool> virhe(false);
+            std::vector<std::exception_ptr> poikkeukset(n);
+            std::size_t ikkunat = 0;
+
+            auto saie = [&](std::size_t i) {
+                lp_tila &L = *lp_[i];
+                std::vector<event> uudet;
+                bool oma_virhe = false;
+                // poikkeus ei saa poistua säikeestä eikä ohittaa puomia
+                auto talleta = [&]() {
+                    if(!poikkeukset[i])
+                    {
+                        poikkeukset[i] = std::current_exception();
+                    }
+                    oma_virhe = true;
+                };
+                try
+                {
+                    L.jono = std::priority_queue<event>(std::less<event>(), std::move(L.alku));
+                    L.alku.clear();
+                }
+                catch(...)
+                {
+                    talleta();
+                }
+                for(;;)
+                {
+                    // virhe välitetään muille arvolla -inf, jotta kaikki lopettavat samalla kierroksella
+                    minimit[i] = oma_virhe ? -std::numeric_limits<double>::infinity()
+                               : L.jono.empty() ? std::numeric_limits<double>::infinity()
+                               : L.jono.top().execution_time;
+                    p.odota();
+                    // kaikki säikeet tekevät saman päätöksen samoista arvoista
+                    const double T = *std::min_element(minimit.begin(), minimit.end());
+                    if(std::isinf(T))
+                    {
+                        break;
+                    }
+                    const double loppu = T + ennakko;
+                    if(i == 0)
+                    {
+                        ++ikkunat;
+                        FYSA120_LASKURI("pdes.windows");
+                    }
+
+                    try
+                    {
+                        while(!L.jono.empty() && L.jono.top().execution_time < loppu)
+                        {
+                            const event e = L.jono.top();
+                            L.jono.pop();
+                            for(auto h : havainnoijat[i])
+                            {
+                                h->havaitse(e);
+                            }
+                            if(!jarjestetyt.empty())
+                            {
+                                L.suoritetut.push_back(e);
+                            }
+                            if(!kasittelija)
+                            {
+                                continue;
+                            }
+                            uudet.clear();
+                            kasittelija(e, uudet);
+                            for(const auto &u : uudet)
+                            {
+                                const std::size_t j = lp(u);
+                                if(j == i && u.execution_time >= e.execution_time)
+                                {
+                                    L.jono.push(u);
+                                }
+                                else if(j != i && u.execution_time >= e.execution_time + ennakko)
+                                {
+                                    FYSA120_LASKURI("pdes.messages");
+                                    std::lock_guard<std::mutex> lukko(lp_[j]->m);
+                                    lp_[j]->saapuneet.push_back(u);
+                                }
+                                else
+                                {
+                                    oma_virhe = true;
+                                }
+                            }
+                        }
+                    }
+                    catch(...)
+                    {
+                        talleta();
+                    }
+
+                    // kaikki ikkunan viestit on lähetetty
+                    p.odota();
+                    try
+                    {
+                        {
+                            std::lock_guard<std::mutex> lukko(L.m);
+                            for(const auto &u : L.saapuneet)
+                            {
+                                L.jono.push(u);
+                            }
+                            L.saapuneet.clear();
+                        }
+                        // muut säikeet lisäävät suoritettuja vasta seuraavan ikkunan
+                        // alun puomin jälkeen, johon säie 0 saapuu lomituksen jälkeen
+                        if(i == 0 && !jarjestetyt.empty())
+                        {
+                            lomita(jarjestetyt);
+                        }
+                    }
+                    catch(...)
+                    {
+                        talleta();
+                    }
+                }
+                if(oma_virhe)
+                {
+                    virhe = true;
+                }
+            };
+
+            std::vector<std::thread> saikeet;
+            for(std::size_t i = 1 ; i < n ; ++i)
+            {
+                saikeet.emplace_back(saie, i);
+            }
+            saie(0);
+            for(auto &t : saikeet)
+            {
+                t.join();
+            }
+            for(const auto &e : poikkeukset)
+            {
+                if(e)
+                {
+                    std::rethrow_exception(e);
+                }
+            }
+            if(virhe)
+            {
+                throw std::logic_error("rinnakkainen_simulaatio: tapahtuma rikkoo ennakon (kausaalisuus)");
+            }
+            return ikkunat;
+        }
+
+    private:
+        /**
+         * Loogisen prosessin tila.
+         */
+        struct lp_tila
+        {
+            std::vector<event> alku;            ///< alkutapahtumat ennen aja():a
+            std::priority_queue<event> jono;
+            std::mutex m;
+            std::vector<event> saapuneet;       ///< muilta LP:iltä saapuneet, toimitetaan ikkunan jälkeen
+            std::vector<event> suoritetut;      ///< ikkunassa suoritetut, suoritusjärjestyksessä
+        };
+
+        /**
+         * Lomittaa LP:iden ikkunassa suoritetut tapahtumat suoritusajan mukaan
+         * ja kutsuu niille havainnoijat. Jokainen LP:n lista on jo järjestyksessä,
+         * joten lomitus maksaa O(m log lpt).
+         */
+        void lomita(const std::vector<havainnoija*> &jarjestetyt)
+        {
+            // (tapahtuma, LP) -pareista päällimmäisenä aikaisin suoritusaika
+            std::priority_queue<std::pair<event, std::size_t>> karjet;
+            std::vector<std::size_t> paikka(lp_.size(), 0);
+            for(std::size_t j = 0 ; j < lp_.size() ; ++j)
+            {
+                if(!lp_[j]->suoritetut.empty())
+                {
+                    karjet.push(std::make_pair(lp_[j]->suoritetut[0], j));
+                }
+            }
+            while(!karjet.empty())
+            {
+                const std::size_t j = karjet.top().second;
+                for(auto h : jarjestetyt)
+                {
+                    h->havaitse(karjet.top().first);
+                }
+                karjet.pop();
+                const std::vector<event> &v = lp_[j]->suoritetut;
+                if(++paikka[j] < v.size())
+                {
+                    karjet.push(std::make_pair(v[paikka[j]], j));
+                }
+            }
+            for(auto &L : lp_)
+            {
+                L->suoritetut.clear();
+            }
+        }
+
+        jako_t jako_;
+        std::vector<std::unique_ptr<lp_tila>> lp_;
+    };
+
 }
 
 
+#ifndef FYSA120_NO_MAIN
 /**
  * Pääohjelma testaamista varten.
  */
 int main(void)
 {
+    FYSA120_PROFIILI("ex2");
     std::cout << "Exercise 2: Kinetic Monte Carlo" << std::endl;
     
     std::vector<fysa120::event> events;
@@ -166,6 +849,98 @@ int main(void)
     fysa120::run_simulation(queue);
     std::cout << "Tapahtumia jonossa: " << queue.size() << std::endl;
 
+    // kaksi suurempaa toistoa havainnoijilla, tulokset yhdistetään
+    fysa120::momentti_havainnoija m;
+    fysa120::prosessilaskuri p;
+    fysa120::odotushistogrammi o(50.0, 10);
+    fysa120::lapaisy l(0.0, 60.0, 6);
+    for(int toisto = 0 ; toisto < 2 ; ++toisto)
+    {
+        fysa120::momentti_havainnoija m2;
+        fysa120::prosessilaskuri p2;
+        fysa120::odotushistogrammi o2(50.0, 10);
+        fysa120::lapaisy l2(0.0, 60.0, 6);
+        events.clear();
+        fysa120::generate_events(events,100000);
+        fysa120::insert_events_priority_queue(queue,events);
+        fysa120::run_simulation(queue, {&m2, &p2, &o2, &l2});
+        m.yhdista(m2);
+        p.yhdista(p2);
+        o.yhdista(o2);
+        l.yhdista(l2);
+    }
+    std::cout << "Odotusaika: keskiarvo " << m.odotus().ka << ", keskihajonta " << std::sqrt(m.odotus().varianssi())
+              << ", min " << m.odotus().pienin << ", max " << m.odotus().suurin << " (n = " << m.odotus().n << ")" << std::endl;
+    std::cout << "Suoritusten väli: keskiarvo " << m.vali().ka << std::endl;
+    for(std::size_t i = 0 ; i < p.prosesseja() ; ++i)
+    {
+        std::cout << "Prosessi " << i << ": " << p.maara(i) << " tapahtumaa, " << p.nopeus(i) << " / aikayksikkö" << std::endl;
+    }
+    const fysa120::histogrammi &h = o.jakauma();
+    for(std::size_t i = 0 ; i < h.koko() ; ++i)
+    {
+        std::cout << "Odotusaika [" << h.alku() + i*h.leveys() << ", " << h.alku() + (i+1)*h.leveys() << "): " << h[i] << std::endl;
+    }
+    std::cout << "Odotusaika >= " << h.alku() + h.koko()*h.leveys() << ": " << h.ylivuoto() << std::endl;
+    for(std::size_t i = 0 ; i < l.lokerot().koko() ; ++i)
+    {
+        std::cout << "Läpäisy [" << l.lokerot().alku() + i*l.lokerot().leveys() << ", "
+                  << l.lokerot().alku() + (i+1)*l.lokerot().leveys() << "): " << l.nopeus(i) << " / aikayksikkö" << std::endl;
+    }
+
+    // sama data peräkkäin ja rinnakkain neljällä LP:llä (ennakkoikkunat 1 aikayksikkö)
+    events.clear();
+    fysa120::generate_events(events,100000);
+    fysa120::prosessilaskuri p_seq;
+    fysa120::odotushistogrammi o_seq(50.0, 10);
+    fysa120::momentti_havainnoija m_seq;
+    fysa120::lapaisy l_seq(0.0, 60.0, 6);
+    fysa120::insert_events_priority_queue(queue,events);
+    fysa120::run_simulation(queue, {&p_seq, &o_seq, &m_seq, &l_seq});
+
+    const std::size_t lpt = 4;
+    fysa120::rinnakkainen_simulaatio sim(lpt);
+    sim.lisaa(events);
+    std::vector<fysa120::prosessilaskuri> p_lp(lpt);
+    std::vector<fysa120::odotushistogrammi> o_lp(lpt, fysa120::odotushistogrammi(50.0, 10));
+    std::vector<fysa120::momentti_havainnoija> m_lp(lpt);
+    std::vector<fysa120::lapaisy> l_lp(lpt, fysa120::lapaisy(0.0, 60.0, 6));
+    std::vector<std::vector<fysa120::havainnoija*>> h_lp(lpt);
+    for(std::size_t i = 0 ; i < lpt ; ++i)
+    {
+        h_lp[i] = {&p_lp[i], &o_lp[i], &m_lp[i], &l_lp[i]};
+    }
+    // suoritusjärjestyksestä riippuva vali lasketaan lomitetusta järjestyksestä
+    fysa120::momentti_havainnoija m_jarj;
+    const std::size_t ikkunat = sim.aja(h_lp, {&m_jarj});
+    for(std::size_t i = 1 ; i < lpt ; ++i)
+    {
+        p_lp[0].yhdista_osa(p_lp[i]);
+        o_lp[0].yhdista(o_lp[i]);
+        m_lp[0].yhdista(m_lp[i]);
+        l_lp[0].yhdista(l_lp[i]);
+    }
+    auto lahella = [](double a, double b) { return std::abs(a - b) <= 1.0e-12 * std::abs(b); };
+    bool sama = lahella(m_lp[0].odotus().ka, m_seq.odotus().ka)
+             && m_jarj.vali().n == m_seq.vali().n
+             && lahella(m_jarj.vali().ka, m_seq.vali().ka)
+             && lahella(m_jarj.vali().varianssi(), m_seq.vali().varianssi());
+    for(std::size_t i = 0 ; i < p_seq.prosesseja() ; ++i)
+    {
+        sama = sama && p_lp[0].maara(i) == p_seq.maara(i) && lahella(p_lp[0].nopeus(i), p_seq.nopeus(i));
+    }
+    for(std::size_t i = 0 ; i < o_seq.jakauma().koko() ; ++i)
+    {
+        sama = sama && o_lp[0].jakauma()[i] == o_seq.jakauma()[i];
+    }
+    for(std::size_t i = 0 ; i < l_seq.lokerot().koko() ; ++i)
+    {
+        sama = sama && lahella(l_lp[0].nopeus(i), l_seq.nopeus(i));
+    }
+    std::cout << "Rinnakkainen simulaatio (" << lpt << " LP, " << ikkunat << " ikkunaa): "
+              << (sama ? "sama tulos kuin peräkkäin" : "ERI TULOS kuin peräkkäin") << std::endl;
+
     return 0;
 }
+#endif
 
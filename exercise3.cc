@@ -15,6 +15,7 @@
 #include <array>
 #include <fstream>
 #include <boost/numeric/odeint.hpp>
+#include "profiling.hpp"
 
 
 /**
@@ -45,7 +46,7 @@ namespace fysa120
      */
     void ratkaistava_dy(const state_type &x, state_type &dxdt, const double /*t*/)
     {
-        //
+        FYSA120_LASKURI("ode.rhs_calls");
         dxdt[0] = x[1];
         dxdt[1] = 6 * x[1] - x[0]; 
     }
@@ -57,7 +58,7 @@ namespace fysa120
      */
     void suorita_fixed_step_ratkasin(void)
     {
-        //
+        FYSA120_AJASTIN("ode.fixed_step");
         std::ofstream out("ode_fixed.dat");
         odeint::runge_kutta4<state_type> rk4;       ///< Käytettävä ratkaisumenetelmä
         state_type x = {{2.0, 5.0/2.0 }};           ///< alkuarvot y(0)=2 ja y'(0)=5/2
@@ -65,6 +66,7 @@ namespace fysa120
         for(double t = 0.0 ; t < 20.0 ; t += dt)    ///< Haetaan ratkaisu välillä 0 < t < 20
         {
             rk4.do_step(ratkaistava_dy,x,t,dt);     ///< Haetaan yksi ratkaisu pisteessä t
+            FYSA120_LASKURI("ode.fixed_step.steps");
             out << t << " " << x[0] << " " << x[1] << std::endl;    ///< t y(t) y'(t)
         }
         out.close();
@@ -77,7 +79,7 @@ namespace fysa120
      */
     void suorita_adaptive_step_ratkaisin(void)
     {
-        //
+        FYSA120_AJASTIN("ode.adaptive_step");
         std::ofstream out("ode_adaptive.dat");
         typedef odeint::runge_kutta_cash_karp54<state_type> stepper_type;       ///< Käytettävä ratkaisumenetelmä
         double abs_err = 1.0e-10 , rel_err = 1.0e-6;    ///< absoluuttinen virheraja , suhteellinen virheraja
@@ -87,7 +89,15 @@ namespace fysa120
         double t = 0.0;
         while(t < 20.0)
         {
-            stepper.try_step(ratkaistava_dy,x,t,dt);
+            if(stepper.try_step(ratkaistava_dy,x,t,dt) == odeint::success)
+            {
+                FYSA120_LASKURI("ode.adaptive_step.accepted");
+                FYSA120_HISTOGRAMMI("ode.adaptive_step.dt", dt);
+            }
+            else
+            {
+                FYSA120_LASKURI("ode.adaptive_step.rejected");
+            }
             out << t << " " << x[0] << " " << x[1] << std::endl;    ///< t y(t) y'(t)
             /**
              * try_step()
@@ -102,12 +112,15 @@ namespace fysa120
 }
 
 
+#ifndef FYSA120_NO_MAIN
 /**
  * Pääohjelma testaamista varten
  */
 int main(void)
 {
+    FYSA120_PROFIILI("ex3");
     fysa120::suorita_fixed_step_ratkasin();
     fysa120::suorita_adaptive_step_ratkaisin();
     return 0;
 }
+#endif
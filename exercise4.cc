@@ -16,6 +16,7 @@
 #include <cmath>
 #include <gsl/gsl_integration.h>
 #include <boost/math/constants/constants.hpp>
+#include "profiling.hpp"
 
 // Integroinnille varattu työtilan koko
 #define LIMIT_SIZE 1000
@@ -49,6 +50,7 @@ namespace fysa120
      */
     double f(double x, void* cparam)
     {
+        FYSA120_LASKURI("qags.f_evals");
         /* reinterpret_cast < new_type > ( expression )     
          *
          * reinterpret_cast expression does not compile to any CPU instructions. 
@@ -68,6 +70,7 @@ namespace fysa120
      */
     void integroi(void)
     {
+        FYSA120_AJASTIN("integroi");
         gsl_integration_workspace *work_ptr = gsl_integration_workspace_alloc(LIMIT_SIZE);
         
         double alaraja = 0.0;
@@ -89,6 +92,9 @@ namespace fysa120
 
         gsl_integration_qags(&funktio, alaraja, ylaraja, abs_virhe, suht_virhe, 
                                         LIMIT_SIZE, work_ptr, &vastaus, &virhe);
+        FYSA120_LASKURI("qags.calls");
+        FYSA120_LASKURI_N("qags.subintervals", work_ptr->size);
+        FYSA120_HISTOGRAMMI("qags.subintervals_per_call", work_ptr->size);
 
         std::cout.setf(std::ios::fixed, std::ios::floatfield);
         std::cout.precision(18);
@@ -98,13 +104,15 @@ namespace fysa120
     }
 }
 
+#ifndef FYSA120_NO_MAIN
 /**
  * Pääohjelma testaamista varten.
  */
 int main(void)
 {
-    //
+    FYSA120_PROFIILI("ex4");
     fysa120::integroi();
     return 0;
 }
+#endif
 
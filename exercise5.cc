@@ -10,13 +10,38 @@
  *
  * clang++ -std=c++11 -I/usr/local/include ./exercise5.cc -o ./ex5 -L/usr/local/lib -larmadillo 
  *
+ * ./ex5 --binary kirjoittaa tulokset binäärimuodossa (xy_data.bin, fit_data.bin),
+ * ks. binary_io.hpp ja muunna.cc.
+ *
+ * ./ex5 -n 1000000 --tila harva muodostaa suunnittelumatriisin harvana
+ * (bspline_fit.hpp), jolloin kantafunktioita lasketaan vain p+1 pistettä kohden.
+ * --tila kaista ratkaisee sovituksen kaistamuotoisella QR:llä muodostamatta
+ * suunnittelumatriisia lainkaan. Tiheä ratkaisu (oletus) on tarkistusta varten.
+ * --tila virta syöttää näytteet yksi kerrallaan inkrementaaliselle sovittimelle
+ * (bspline_virta), valinnaisesti unohduskertoimella --unohdus lambda.
+ * Muissa kuin tiheässä tilassa sovituskäyrän P pistettä (-P, oletus 1000)
+ * lasketaan de Boorin algoritmilla usealla säikeellä (--saikeet).
+ *
+ * ./ex5 --tila tasoitus -n 100000 sovittaa tasavälisillä solmuilla (--solmuvalit K,
+ * oletus 40) kertoimien erotussakolla (--ero k, oletus 2) tasoitetun käyrän
+ * (P-spline). Sakon paino valitaan yleistetyllä ristiinvalidoinnilla, ellei sitä
+ * anneta valinnalla --lambda L, ks. bspline_tasoitus.
+ *
+ * ./ex5 --tila pinta -n 500 -P 200 sovittaa tensoritulopinnan N x N hilaan
+ * (xyz_data.dat) ja laskee pinnan P x P hilassa (pinta_fit.dat). Sovitus
+ * ratkaistaan kahdella 1D kaistamuotoisella hajotelmalla (sovita_pinta).
+ *
  */
 #include <iostream>
 #include <fstream>
 #include <cstdlib>
 #include <vector>
 #include <armadillo>
+#include <string>
 #include "Bspline.hpp"
+#include "bspline_fit.hpp"
+#include "binary_io.hpp"
+#include "profiling.hpp"
 
 
 /**
@@ -24,16 +49,80 @@
  */
 namespace fysa120
 {
+    /**
+     * Komentoriviltä luettavat asetukset.
+     */
+    struct asetukset
+    {
+        int N = 100;                    ///< datapisteiden määrä
+        int P = 1000;                   ///< sovituskäyrän pisteiden määrä
+        unsigned saikeet = 0;           ///< säikeiden määrä käyrän laskentaan, 0 = kaikki
+        std::string tila = "tihea";     ///< sovitustapa: "tihea" (Bspline::B), "harva", "kaista", "virta", "tasoitus" tai "pinta"
+        double unohdus = 1.0;           ///< virta-tilan unohduskerroin
+        double lambda = -1.0;           ///< tasoitusparametri, < 0 = valitaan GCV:llä
+        int ero = 2;                    ///< tasoitus-tilan erotussakon kertaluku
+        int solmuvalit = 40;            ///< tasoitus-tilan solmuvälien määrä
+        bool binaari = false;           ///< tulokset binäärimuodossa
+    };
+
+
+    /**
+     * Lukee komentorivin valinnat.
+     * @return true jos valinnat ovat virheelliset
+     */
+    bool lue_asetukset(int argc, char *argv[], asetukset &a)
+    {
+        for(int i = 1 ; i < argc ; ++i)
+        {
+            std::string s = argv[i];
+            bool arvo = (i+1 < argc);
+            if(s == "--binary")                 a.binaari = true;
+            else if(s == "-n" && arvo)          a.N = std::atoi(argv[++i]);
+            else if(s == "-P" && arvo)          a.P = std::atoi(argv[++i]);
+            else if(s == "--saikeet" && arvo)   a.saikeet = std::atoi(argv[++i]);
+            else if(s == "--unohdus" && arvo)   a.unohdus = std::atof(argv[++i]);
+            else if(s == "--lambda" && arvo)    a.lambda = std::atof(argv[++i]);
+            else if(s == "--ero" && arvo)       a.ero = std::atoi(argv[++i]);
+            else if(s == "--solmuvalit" && arvo) a.solmuvalit = std::atoi(argv[++i]);
+            else if(s == "--tila" && arvo)      a.tila = argv[++i];
+            else
+            {
+                return true;
+            }
+        }
+        return a.N < 2 || a.P < 2 || (a.tila != "tihea" && a.tila != "harva" && a.tila != "kaista" && a.tila != "virta"
+                                       && a.tila != "tasoitus" && a.tila != "pinta")
+            || !(a.unohdus > 0.0 && a.unohdus <= 1.0) || a.ero < 0 || a.solmuvalit < 1;
+    }
+
+
+    /**
+     * Tasavälinen kuutiollinen kanta välillä [a,b], päätesolmut toistettu.
+     * @param K Solmuvälien määrä
+     */
+    bspline_kanta tasavalinen_kanta(double a, double b, int K)
+    {
+        std::vector<double> t(K + 7);
+        for(int i = 0 ; i < K + 7 ; ++i)
+        {
+            int k = std::min(std::max(i - 3, 0), K);
+            t[i] = a + (b - a)*k/K;
+        }
+        return bspline_kanta(t, 3);
+    }
+
     
    /**
     * Generoi dataa johon tehdään b-spline sovitus.
     * Data talletetaan tiedostoon: xy_data.dat
     * Sovitettu käyrä talletetaan tiedostoon: fit_data.dat 
+    *
+    * @param a Asetukset: datapisteiden määrä, sovitustapa ja tulostusmuoto
     */
-    void suorita_bspline_sovitus(void)
+    void suorita_bspline_sovitus(const asetukset &a)
     {
         // datapisteiden määrä
-        const int N=100;
+        const int N = a.N;
         
         // alustetaan b-spline
         std::vector<double> t{0,1,2,3,4,4,4,5,6,7,8,9,10};
@@ -50,48 +139,182 @@ namespace fysa120
             y[i] = 3*std::exp(-std::abs(xx-4))+noise;
         }
 
-        // muodostetaan kerroinmatriisi A: A_ij = B_j(x_i)
-        arma::mat A;
-        A.set_size(x.size(),bs.max_i());
-        for(int j = 0 ; j < x.size() ; ++j)
+        // sama kanta paikallisesti: aste p = m - 1 - M, tasoituksessa tiheämpi tasavälinen kanta
+        bspline_kanta kanta = (a.tila == "tasoitus") ? tasavalinen_kanta(0.0, 10.0, a.solmuvalit)
+                                                     : bspline_kanta(t, static_cast<int>(t.size()) - 1 - bs.max_i());
+
+        arma::vec c;
+        if(a.tila == "tihea")
         {
-            for(int i = 0 ; i < bs.max_i() ; ++i)
+            // muodostetaan kerroinmatriisi A: A_ij = B_j(x_i)
+            arma::mat A;
             {
-                A(j,i) = bs.B(i,x[j]);
+                FYSA120_AJASTIN("bspline.design_matrix");
+                A.set_size(x.size(),bs.max_i());
+                for(int j = 0 ; j < x.size() ; ++j)
+                {
+                    for(int i = 0 ; i < bs.max_i() ; ++i)
+                    {
+                        A(j,i) = bs.B(i,x[j]);
+                    }
+                }
+                FYSA120_LASKURI_N("bspline.basis_evals", x.size()*bs.max_i());
             }
-        }
     
-        // ratkaistaan kerroinmatriisi c (vektori)
-        arma::vec c = solve(A,y);
+            // ratkaistaan kerroinmatriisi c (vektori)
+            {
+                FYSA120_AJASTIN("bspline.solve");
+                c = solve(A,y);
+            }
+        }
+        else if(a.tila == "kaista")
+        {
+            // kaistamuotoinen QR suoraan paikallisista kantafunktioista
+            std::vector<double> kertoimet;
+            double kunto;
+            {
+                FYSA120_AJASTIN("bspline.solve");
+                if(sovita_kaista(kanta, x.memptr(), y.memptr(), x.n_elem, kertoimet, kunto))
+                {
+                    std::cerr << "Sovitus epäonnistui: kuntoisuusluku " << kunto << std::endl;
+                    return;
+                }
+                FYSA120_LASKURI_N("bspline.basis_evals", x.size()*(kanta.aste()+1));
+            }
+            c = arma::vec(kertoimet);
+        }
+        else if(a.tila == "tasoitus")
+        {
+            // P-spline: lambda annettuna tai GCV:n minimi
+            std::vector<double> kertoimet;
+            double lambda = a.lambda;
+            double jalki;
+            double arvo;
+            {
+                FYSA120_AJASTIN("bspline.solve");
+                bspline_tasoitus tasoitus(kanta, x.memptr(), y.memptr(), x.n_elem, a.ero);
+                bool virhe;
+                if(lambda < 0.0)
+                {
+                    virhe = tasoitus.valitse(lambda, kertoimet, jalki, arvo);
+                }
+                else
+                {
+                    double jaannos;
+                    virhe = tasoitus.sovita(lambda, kertoimet, jalki, jaannos);
+                    arvo = N * jaannos / ((N - jalki) * (N - jalki));
+                }
+                if(virhe)
+                {
+                    std::cerr << "Sovitus epäonnistui" << std::endl;
+                    return;
+                }
+                FYSA120_LASKURI_N("bspline.basis_evals", x.size()*(kanta.aste()+1));
+            }
+            std::cout << "lambda " << lambda << ", vapausasteet " << jalki << ", GCV " << arvo << std::endl;
+            c = arma::vec(kertoimet);
+        }
+        else if(a.tila == "virta")
+        {
+            // näytteet saapuvat yksi kerrallaan, kertoimet pyydetään lopuksi
+            bspline_virta virta(kanta, a.unohdus);
+            std::vector<double> kertoimet;
+            double kunto;
+            {
+                FYSA120_AJASTIN("bspline.solve");
+                for(int i = 0 ; i < N ; ++i)
+                {
+                    virta.lisaa(x[i], y[i]);
+                }
+                if(virta.kertoimet(kertoimet, kunto))
+                {
+                    std::cerr << "Sovitus epäonnistui: kuntoisuusluku " << kunto << std::endl;
+                    return;
+                }
+                FYSA120_LASKURI_N("bspline.basis_evals", x.size()*(kanta.aste()+1));
+            }
+            c = arma::vec(kertoimet);
+        }
+        else
+        {
+            // harva kerroinmatriisi: vain p+1 nollasta poikkeavaa arvoa riviä kohden
+            arma::sp_mat A;
+            {
+                FYSA120_AJASTIN("bspline.design_matrix");
+                A = suunnittelumatriisi(kanta, x.memptr(), x.n_elem).harva();
+                FYSA120_LASKURI_N("bspline.basis_evals", x.size()*(kanta.aste()+1));
+            }
 
-        // tehdään x pisteet sovituskäyrää varten (1000 pistettä välille 0-10)
-        arma::vec X(1000); 
-        for(int i = 0 ; i < 1000 ; ++i)
+            // normaaliyhtälöt A^T A c = A^T y ovat vain M x M
+            {
+                FYSA120_AJASTIN("bspline.solve");
+                arma::mat G(A.t()*A);
+                arma::vec b = A.t()*y;
+                c = solve(G,b);
+            }
+        }
+
+        // tehdään x pisteet sovituskäyrää varten (oletuksena 1000 pistettä välille 0-10)
+        const int P = a.P;
+        arma::vec X(P); 
+        for(int i = 0 ; i < P ; ++i)
         {
-            double xx = i*10.0/(1000-1);
+            double xx = i*10.0/(P-1);
             X[i] = xx;
         }
 
-        // muodostetaan kerroinmatriisi B sovituskäyrää varten
-        arma::mat B;
-        B.set_size(X.size(),bs.max_i());
-        for(int j = 0 ; j < X.size() ; ++j)
+        arma::vec Y;
+        if(a.tila == "tihea")
         {
-            for(int i = 0 ; i < bs.max_i() ; ++i)
+            // muodostetaan kerroinmatriisi B sovituskäyrää varten
+            arma::mat B;
             {
-                B(j,i) = bs.B(i,X[j]);
+                FYSA120_AJASTIN("bspline.evaluate");
+                B.set_size(X.size(),bs.max_i());
+                for(int j = 0 ; j < X.size() ; ++j)
+                {
+                    for(int i = 0 ; i < bs.max_i() ; ++i)
+                    {
+                        B(j,i) = bs.B(i,X[j]);
+                    }
+                }
+                FYSA120_LASKURI_N("bspline.basis_evals", X.size()*bs.max_i());
             }
-        }
 
-        // Muodostetaan sovituskäyrän y-koordinaatti
-        arma::vec Y = B * c;
+            // Muodostetaan sovituskäyrän y-koordinaatti
+            Y = B * c;
+        }
+        else
+        {
+            // de Boorin algoritmi suoraan kertoimista, ei matriisia
+            FYSA120_AJASTIN("bspline.evaluate");
+            bspline_kayra kayra(kanta, arma::conv_to<std::vector<double>>::from(c));
+            Y.set_size(P);
+            kayra.arvioi(X.memptr(), Y.memptr(), X.n_elem, a.saikeet);
+        }
     
         // kirjoitetaan tulokset tiedostoihin
+        if(a.binaari)
+        {
+            // sarakkeittain (N,2): ensin x-sarake ja sitten y-sarake
+            if(kirjoita_binaari("xy_data.bin", dtype::f64, {x.n_elem, 2},
+                                {{x.memptr(), x.n_elem*sizeof(double)}, {y.memptr(), y.n_elem*sizeof(double)}}))
+            {
+                std::cerr << "xy_data.bin:n kirjoitus epäonnistui" << std::endl;
+            }
+            if(kirjoita_binaari("fit_data.bin", dtype::f64, {X.n_elem, 2},
+                                {{X.memptr(), X.n_elem*sizeof(double)}, {Y.memptr(), Y.n_elem*sizeof(double)}}))
+            {
+                std::cerr << "fit_data.bin:n kirjoitus epäonnistui" << std::endl;
+            }
+            return;
+        }
+
         // Data
         std::ofstream out("xy_data.dat");
         for(int i = 0 ; i < x.size() ; ++i)
         {
-            out << x[i] << " " << y[i] << std::endl;
+            out << x[i] << " " << y[i] << '\n';
         }
         out.close();
     
@@ -99,21 +322,157 @@ namespace fysa120
         std::ofstream out2("fit_data.dat");
         for(int i = 0 ; i < X.size() ; ++i)
         {
-            out2 << X[i] << " " << Y[i] << std::endl;
+            out2 << X[i] << " " << Y[i] << '\n';
+        }
+        out2.close();
+    }
+
+
+   /**
+    * Generoi hiladataa z(x,y) ja sovittaa siihen tensoritulopinnan.
+    * Data talletetaan tiedostoon: xyz_data.dat
+    * Sovitettu pinta talletetaan tiedostoon: pinta_fit.dat
+    * (gnuplotin splot-muoto: tyhjä rivi jokaisen x-rivin jälkeen)
+    *
+    * @param a Asetukset: hilan koko N x N, tuloshilan koko P x P, säikeet ja tulostusmuoto
+    */
+    void suorita_pinta_sovitus(const asetukset &a)
+    {
+        const std::size_t N = a.N;
+        const std::size_t P = a.P;
+
+        // x-suunnassa sama kanta kuin 1D sovituksessa, y-suunnassa tasaväliset solmut
+        std::vector<double> tx{0,1,2,3,4,4,4,5,6,7,8,9,10};
+        std::vector<double> ty{0,0,0,0,1,2,3,4,5,6,7,8,9,10,10,10,10};
+        bspline_kanta kx(tx, 3);
+        bspline_kanta ky(ty, 3);
+
+        // muodostetaan hiladata välille [0,10] x [0,10]
+        std::vector<double> x(N);
+        std::vector<double> y(N);
+        std::vector<double> z(N*N);
+        for(std::size_t i = 0 ; i < N ; ++i)
+        {
+            x[i] = i*10.0/(N-1);
+            y[i] = x[i];
+        }
+        for(std::size_t i = 0 ; i < N ; ++i)
+        {
+            for(std::size_t j = 0 ; j < N ; ++j)
+            {
+                auto noise = 0.2*(std::rand()*1.0/RAND_MAX-0.5);
+                z[i*N + j] = 3*std::exp(-std::abs(x[i]-4))*std::cos(0.5*y[j])+noise;
+            }
+        }
+
+        std::vector<double> C;
+        double kunto;
+        {
+            FYSA120_AJASTIN("bspline.solve");
+            if(sovita_pinta(kx, ky, x.data(), N, y.data(), N, z.data(), C, kunto, a.saikeet))
+            {
+                std::cerr << "Sovitus epäonnistui: kuntoisuusluku " << kunto << std::endl;
+                return;
+            }
+            FYSA120_LASKURI_N("bspline.basis_evals", 2*N*(kx.aste()+1));
+        }
+
+        // pinta P x P hilassa
+        std::vector<double> X(P);
+        for(std::size_t i = 0 ; i < P ; ++i)
+        {
+            X[i] = i*10.0/(P-1);
+        }
+        std::vector<double> Z(P*P);
+        {
+            FYSA120_AJASTIN("bspline.evaluate");
+            bspline_pinta pinta(kx, ky, C);
+            pinta.arvioi_hila(X.data(), P, X.data(), P, Z.data(), a.saikeet);
+        }
+
+        if(a.binaari)
+        {
+            // sarakkeittain (N*N,3): x, y ja z, y muuttuu nopeimmin
+            std::vector<double> xs(N*N);
+            std::vector<double> ys(N*N);
+            for(std::size_t i = 0 ; i < N*N ; ++i)
+            {
+                xs[i] = x[i / N];
+                ys[i] = y[i % N];
+            }
+            if(kirjoita_binaari("xyz_data.bin", dtype::f64, {N*N, 3},
+                                {{xs.data(), xs.size()*sizeof(double)}, {ys.data(), ys.size()*sizeof(double)},
+                                 {z.data(), z.size()*sizeof(double)}}))
+            {
+                std::cerr << "xyz_data.bin:n kirjoitus epäonnistui" << std::endl;
+            }
+            std::vector<double> Xs(P*P);
+            std::vector<double> Ys(P*P);
+            for(std::size_t i = 0 ; i < P*P ; ++i)
+            {
+                Xs[i] = X[i / P];
+                Ys[i] = X[i % P];
+            }
+            if(kirjoita_binaari("pinta_fit.bin", dtype::f64, {P*P, 3},
+                                {{Xs.data(), Xs.size()*sizeof(double)}, {Ys.data(), Ys.size()*sizeof(double)},
+                                 {Z.data(), Z.size()*sizeof(double)}}))
+            {
+                std::cerr << "pinta_fit.bin:n kirjoitus epäonnistui" << std::endl;
+            }
+            return;
+        }
+
+        std::ofstream out("xyz_data.dat");
+        for(std::size_t i = 0 ; i < N ; ++i)
+        {
+            for(std::size_t j = 0 ; j < N ; ++j)
+            {
+                out << x[i] << " " << y[j] << " " << z[i*N + j] << '\n';
+            }
+            out << '\n';
+        }
+        out.close();
+
+        std::ofstream out2("pinta_fit.dat");
+        for(std::size_t i = 0 ; i < P ; ++i)
+        {
+            for(std::size_t j = 0 ; j < P ; ++j)
+            {
+                out2 << X[i] << " " << X[j] << " " << Z[i*P + j] << '\n';
+            }
+            out2 << '\n';
         }
         out2.close();
     }
 }
 
 
+#ifndef FYSA120_NO_MAIN
 /**
  * Pääohjelma testaamista varten
  */
-int main(void)
+int main(int argc, char *argv[])
 {
-    fysa120::suorita_bspline_sovitus();
+    FYSA120_PROFIILI("ex5");
+    fysa120::asetukset a;
+    if(fysa120::lue_asetukset(argc, argv, a))
+    {
+        std::cerr << "Käyttö: " << argv[0] << " [-n N] [-P P] [--tila tihea|harva|kaista|virta|tasoitus|pinta] [--unohdus L]"
+                  << " [--lambda L] [--ero k] [--solmuvalit K]"
+                  << " [--saikeet S] [--binary]" << std::endl;
+        return 1;
+    }
+    if(a.tila == "pinta")
+    {
+        fysa120::suorita_pinta_sovitus(a);
+    }
+    else
+    {
+        fysa120::suorita_bspline_sovitus(a);
+    }
     return 0;
 }
+#endif
 
 /*
 gnuplot:
@@ -132,5 +491,10 @@ set xrange [0 to 10]
 set yrange [-0.5 to 3.5]
 plot "xy_data.dat" title "data", "fit_data.dat" title "B-spline fit" pt 7 ps .2
 
+# pinta (--tila pinta)
+set output "pinta.png"
+set zrange [-3.5 to 3.5]
+splot "pinta_fit.dat" title "B-spline pinta" with lines
+
 
 */
\ No newline at end of file
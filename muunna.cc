@@ -0,0 +1,79 @@
+/**
+ * @file muunna.cc
+ * @brief FYSA120 tulostiedostojen muunnin
+ * @author keijo.k.a.salonen@student.jyu.fi
+ *
+ * Muuntaa tekstimuotoiset tulostiedostot (xy_data.dat, fit_data.dat, A.mat)
+ * binäärimuotoon (binary_io.hpp) ja takaisin.
+ *
+ * @note
+ *
+ * clang++ -std=c++11 ./muunna.cc -o ./muunna
+ *
+ * ./muunna bin xy_data.dat xy_data.bin
+ * ./muunna txt xy_data.bin xy_data.dat
+ * ./muunna info A.bin
+ *
+ */
+#include <iostream>
+#include <string>
+#include "binary_io.hpp"
+
+
+/**
+ * Tulostaa binääritiedoston otsakkeen tiedot.
+ * @return true jos tiedosto ei ole kelvollinen
+ */
+bool tulosta_info(const std::string &nimi)
+{
+    fysa120::binaari_tiedosto b;
+    if(b.avaa(nimi))
+    {
+        return true;
+    }
+    const fysa120::binaari_otsake &o = b.otsake();
+    std::cout << "tyyppi: " << o.tyyppi << " (alkion koko " << fysa120::dtype_koko(b.tyyppi()) << ")\n"
+              << "muoto:";
+    for(std::uint32_t i = 0 ; i < o.ndim ; ++i)
+    {
+        std::cout << " " << o.muoto[i];
+    }
+    std::cout << "\njärjestys: " << (b.riveittain() ? "riveittäin" : "sarakkeittain") << "\n"
+              << "tavut: " << o.tavut << "\n"
+              << "tarkiste: " << (b.tarkista() ? "VIRHE" : "ok") << std::endl;
+    return false;
+}
+
+
+/**
+ * Pääohjelma
+ */
+int main(int argc, char *argv[])
+{
+    std::string komento = (argc > 1) ? argv[1] : "";
+    bool virhe = true;
+    if(komento == "bin" && argc == 4)
+    {
+        virhe = fysa120::teksti_binaariksi(argv[2], argv[3]);
+    }
+    else if(komento == "txt" && argc == 4)
+    {
+        virhe = fysa120::binaari_tekstiksi(argv[2], argv[3]);
+    }
+    else if(komento == "info" && argc == 3)
+    {
+        virhe = tulosta_info(argv[2]);
+    }
+    else
+    {
+        std::cerr << "Käyttö: " << argv[0] << " bin|txt <sisään> <ulos>\n"
+                  << "        " << argv[0] << " info <tiedosto.bin>" << std::endl;
+        return 1;
+    }
+    if(virhe)
+    {
+        std::cerr << "Muunnos epäonnistui" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,305 @@
+/**
+ * @file profiling.hpp
+ * @brief FYSA120 ajastimet, laskurit ja histogrammit
+ * @author keijo.k.a.salonen@student.jyu.fi
+ *
+ * Kevyt mittauskerros ohjelmille. Mittaus on käytössä vain, kun ohjelma
+ * käännetään määrittelyllä FYSA120_PROFILE:
+ *
+ * clang++ -std=c++11 -DFYSA120_PROFILE ./exercise2.cc -o ./ex2
+ *
+ * Ilman sitä kaikki makrot laajenevat tyhjiksi eikä niiden argumentteja
+ * lasketa. Käytössä ollessaan ohjelma kirjoittaa lopuksi JSON-raportin
+ * tiedostoon <nimi>.profile.json, tai ympäristömuuttujan
+ * FYSA120_PROFILE_OUT osoittamaan tiedostoon.
+ *
+ *   FYSA120_PROFIILI("ex2");                  // raportin nimi, main():ssa
+ *   FYSA120_AJASTIN("simulaatio");            // mittaa aikaa näkyvyysalueen loppuun
+ *   FYSA120_LASKURI("queue.push");            // kasvattaa laskuria yhdellä
+ *   FYSA120_LASKURI_N("qags.subintervals", n);// kasvattaa laskuria n:llä
+ *   FYSA120_HISTOGRAMMI("findroot.iter", i);  // lisää arvon histogrammiin
+ *
+ * Nimien tulee olla merkkijonovakioita. Laskurit ovat atomisia, joten
+ * makroja voi käyttää myös säikeistä.
+ */
+#ifndef FYSA120_PROFILING_HPP
+#define FYSA120_PROFILING_HPP
+
+#ifdef FYSA120_PROFILE
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+/**
+ * fysa120 nimiavaruus
+ */
+namespace fysa120
+{
+    /**
+     * Mittauskerroksen sisäiset tietorakenteet.
+     */
+    namespace profiili
+    {
+        /**
+         * Atominen liukulukujen summa (C++11:ssä ei ole fetch_add:ia doublelle).
+         */
+        inline void lisaa_atomisesti(std::atomic<double> &a, double v)
+        {
+            double vanha = a.load(std::memory_order_relaxed);
+            while(!a.compare_exchange_weak(vanha, vanha + v, std::memory_order_relaxed)) {}
+        }
+
+        inline void maksimi_atomisesti(std::atomic<double> &a, double v)
+        {
+            double vanha = a.load(std::memory_order_relaxed);
+            while(v > vanha && !a.compare_exchange_weak(vanha, v, std::memory_order_relaxed)) {}
+        }
+
+        inline void minimi_atomisesti(std::atomic<double> &a, double v)
+        {
+            double vanha = a.load(std::memory_order_relaxed);
+            while(v < vanha && !a.compare_exchange_weak(vanha, v, std::memory_order_relaxed)) {}
+        }
+
+
+        /**
+         * Histogrammi log2-lokeroilla: lokero b sisältää positiiviset arvot
+         * [2^(b-32), 2^(b-31)); ääripäiden lokerot sisältävät myös pienemmät ja
+         * suuremmat arvot. Nollat ja negatiiviset arvot lasketaan erikseen.
+         */
+        struct histogrammi
+        {
+            static const int lokeroita = 64;
+            std::atomic<std::uint64_t> lokero[lokeroita];
+            std::atomic<std::uint64_t> ei_positiiviset;
+            std::atomic<std::uint64_t> n;
+            std::atomic<double> summa;
+            std::atomic<double> pienin;
+            std::atomic<double> suurin;
+
+            histogrammi() : ei_positiiviset(0), n(0), summa(0.0), pienin(HUGE_VAL), suurin(-HUGE_VAL)
+            {
+                for(int i = 0 ; i < lokeroita ; ++i) lokero[i] = 0;
+            }
+
+            void lisaa(double v)
+            {
+                if(v > 0.0)
+                {
+                    int b = static_cast<int>(std::floor(std::log2(v))) + 32;
+                    b = b < 0 ? 0 : (b >= lokeroita ? lokeroita-1 : b);
+                    lokero[b].fetch_add(1, std::memory_order_relaxed);
+                }
+                else
+                {
+                    ei_positiiviset.fetch_add(1, std::memory_order_relaxed);
+                }
+                n.fetch_add(1, std::memory_order_relaxed);
+                lisaa_atomisesti(summa, v);
+                minimi_atomisesti(pienin, v);
+                maksimi_atomisesti(suurin, v);
+            }
+        };
+
+
+        /**
+         * Ajastimen kertymä.
+         */
+        struct ajastin
+        {
+            std::atomic<std::uint64_t> kutsut;
+            std::atomic<double> summa;  ///< sekunteina
+            std::atomic<double> suurin;
+
+            ajastin() : kutsut(0), summa(0.0), suurin(0.0) {}
+
+            void lisaa(double s)
+            {
+                kutsut.fetch_add(1, std::memory_order_relaxed);
+                lisaa_atomisesti(summa, s);
+                maksimi_atomisesti(suurin, s);
+            }
+        };
+
+
+        /**
+         * Kaikki nimetyt mittarit. Raportti kirjoitetaan ohjelman lopussa.
+         */
+        class rekisteri
+        {
+        public:
+            static rekisteri &hae(void)
+            {
+                static rekisteri r;
+                return r;
+            }
+
+            std::atomic<std::uint64_t> &hae_laskuri(const char *nimi)
+            {
+                std::lock_guard<std::mutex> lukko(m_);
+                auto &p = laskurit_[nimi];
+                if(!p) p.reset(new std::atomic<std::uint64_t>(0));
+                return *p;
+            }
+
+            ajastin &hae_ajastin(const char *nimi)
+            {
+                std::lock_guard<std::mutex> lukko(m_);
+                auto &p = ajastimet_[nimi];
+                if(!p) p.reset(new ajastin());
+                return *p;
+            }
+
+            histogrammi &hae_histogrammi(const char *nimi)
+            {
+                std::lock_guard<std::mutex> lukko(m_);
+                auto &p = histogrammit_[nimi];
+                if(!p) p.reset(new histogrammi());
+                return *p;
+            }
+
+            void aseta_nimi(const char *n)
+            {
+                std::lock_guard<std::mutex> lukko(m_);
+                ohjelma_ = n;
+            }
+
+            ~rekisteri()
+            {
+                const char *ymp = std::getenv("FYSA120_PROFILE_OUT");
+                std::ofstream out(ymp ? std::string(ymp) : ohjelma_ + ".profile.json");
+                kirjoita_json(out);
+            }
+
+            /**
+             * Kirjoittaa raportin JSON-muodossa.
+             */
+            void kirjoita_json(std::ostream &out)
+            {
+                std::lock_guard<std::mutex> lukko(m_);
+                double kesto = std::chrono::duration<double>(std::chrono::steady_clock::now() - alku_).count();
+                out.precision(9);
+                out << "{\n  \"program\": \"" << ohjelma_ << "\",\n"
+                    << "  \"timestamp\": " << static_cast<long long>(std::time(nullptr)) << ",\n"
+                    << "  \"wall_s\": " << kesto << ",\n  \"counters\": {";
+                const char *erotin = "\n";
+                for(const auto &c : laskurit_)
+                {
+                    out << erotin << "    \"" << c.first << "\": " << c.second->load();
+                    erotin = ",\n";
+                }
+                out << "\n  },\n  \"timers\": {";
+                erotin = "\n";
+                for(const auto &t : ajastimet_)
+                {
+                    std::uint64_t n = t.second->kutsut.load();
+                    out << erotin << "    \"" << t.first << "\": {\"calls\": " << n
+                        << ", \"total_s\": " << t.second->summa.load()
+                        << ", \"mean_s\": " << (n ? t.second->summa.load()/n : 0.0)
+                        << ", \"max_s\": " << t.second->suurin.load() << "}";
+                    erotin = ",\n";
+                }
+                out << "\n  },\n  \"histograms\": {";
+                erotin = "\n";
+                for(const auto &h : histogrammit_)
+                {
+                    const histogrammi &x = *h.second;
+                    std::uint64_t n = x.n.load();
+                    out << erotin << "    \"" << h.first << "\": {\"count\": " << n
+                        << ", \"mean\": " << (n ? x.summa.load()/n : 0.0)
+                        << ", \"min\": " << (n ? x.pienin.load() : 0.0)
+                        << ", \"max\": " << (n ? x.suurin.load() : 0.0)
+                        << ", \"nonpositive\": " << x.ei_positiiviset.load()
+                        << ", \"log2_buckets\": {";
+                    const char *e2 = "";
+                    for(int b = 0 ; b < histogrammi::lokeroita ; ++b)
+                    {
+                        std::uint64_t c = x.lokero[b].load();
+                        if(c == 0) continue;
+                        // avaimena lokeron alaraja
+                        out << e2 << "\"" << std::ldexp(1.0, b-32) << "\": " << c;
+                        e2 = ", ";
+                    }
+                    out << "}}";
+                    erotin = ",\n";
+                }
+                out << "\n  }\n}\n";
+            }
+
+        private:
+            rekisteri() : ohjelma_("fysa120"), alku_(std::chrono::steady_clock::now()) {}
+
+            std::mutex m_;
+            std::string ohjelma_;
+            std::chrono::steady_clock::time_point alku_;
+            std::map<std::string, std::unique_ptr<std::atomic<std::uint64_t>>> laskurit_;
+            std::map<std::string, std::unique_ptr<ajastin>> ajastimet_;
+            std::map<std::string, std::unique_ptr<histogrammi>> histogrammit_;
+        };
+
+
+        /**
+         * Näkyvyysalueen mittainen ajastin.
+         */
+        class mittari
+        {
+        public:
+            explicit mittari(ajastin &a) : a_(a), alku_(std::chrono::steady_clock::now()) {}
+            ~mittari()
+            {
+                a_.lisaa(std::chrono::duration<double>(std::chrono::steady_clock::now() - alku_).count());
+            }
+        private:
+            ajastin &a_;
+            std::chrono::steady_clock::time_point alku_;
+        };
+    }
+}
+
+#define FYSA120_PROF_CAT2(a, b) a##b
+#define FYSA120_PROF_CAT(a, b) FYSA120_PROF_CAT2(a, b)
+#define FYSA120_PROF_VAR(n) FYSA120_PROF_CAT(n, __LINE__)
+
+#define FYSA120_PROFIILI(nimi) \
+    ::fysa120::profiili::rekisteri::hae().aseta_nimi(nimi)
+
+#define FYSA120_AJASTIN(nimi) \
+    static ::fysa120::profiili::ajastin &FYSA120_PROF_VAR(fysa120_ajastin_) = \
+        ::fysa120::profiili::rekisteri::hae().hae_ajastin(nimi); \
+    ::fysa120::profiili::mittari FYSA120_PROF_VAR(fysa120_mittari_)(FYSA120_PROF_VAR(fysa120_ajastin_))
+
+#define FYSA120_LASKURI_N(nimi, n) \
+    do { \
+        static std::atomic<std::uint64_t> &fysa120_laskuri_ = ::fysa120::profiili::rekisteri::hae().hae_laskuri(nimi); \
+        fysa120_laskuri_.fetch_add((n), std::memory_order_relaxed); \
+    } while(0)
+
+#define FYSA120_LASKURI(nimi) FYSA120_LASKURI_N(nimi, 1)
+
+#define FYSA120_HISTOGRAMMI(nimi, arvo) \
+    do { \
+        static ::fysa120::profiili::histogrammi &fysa120_histogrammi_ = \
+            ::fysa120::profiili::rekisteri::hae().hae_histogrammi(nimi); \
+        fysa120_histogrammi_.lisaa(static_cast<double>(arvo)); \
+    } while(0)
+
+#else
+
+#define FYSA120_PROFIILI(nimi) ((void)0)
+#define FYSA120_AJASTIN(nimi) ((void)0)
+#define FYSA120_LASKURI_N(nimi, n) ((void)0)
+#define FYSA120_LASKURI(nimi) ((void)0)
+#define FYSA120_HISTOGRAMMI(nimi, arvo) ((void)0)
+
+#endif
+
+#endif
@@ -10,15 +10,50 @@
  *
  * clang++ -std=c++11 -I/usr/local/include ./project.cc -o ./prj -L/usr/local/lib -lgsl -lgslcblas -larmadillo
  *
+ * Osaspektri (-k) käyttää arma::eigs_gen:iä, joka vaatii ARPACK-tuen armadillossa.
+ * Esim. 10 itseisarvoltaan suurinta ominaisarvoa harvennetusta 2000x2000 matriisista:
+ *
+ * ./prj -n 2000 -k 10 -w lm -t 1e-4
+ *
+ * Suurilla N:n arvoilla tulokset kannattaa kirjoittaa binäärinä ilman tulostusta:
+ *
+ * ./prj -n 2000 -q --binary
+ *
+ * Suurilla N:n arvoilla diagonaalin ulkopuoliset alkiot kannattaa laskea
+ * Chebyshev-sijaismallilla (chebyshev.hpp), jolloin integraaleja tarvitaan
+ * vain laattojen näytepisteissä N^2:n sijaan:
+ *
+ * ./prj -n 5000 -q -k 10 -t 1e-4 --cheb 1e-8
+ *
+ * Sijaismallin tarkkuuden voi tarkistaa pienellä N:llä tarkkaa matriisia vasten:
+ *
+ * ./prj -n 200 -q --cheb 1e-8 --cheb-verify
+ *
  */
 #include <iostream>
 #include <cmath>
+#include <cstdlib>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <set>
+#include <functional>
+#include <algorithm>
+#include <chrono>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
 #include <gsl/gsl_integration.h>
 #include <armadillo>
 #include <complex>
+#include "binary_io.hpp"
+#include "chebyshev.hpp"
+#include "profiling.hpp"
 
 // Integroinnille varattu työtilan koko
 #define LIMIT_SIZE 1000
+// Integroinnin suhteellinen toleranssi; Chebyshev-laattojen toleranssi ei voi olla tätä pienempi
+#define SUHT_VIRHE 1.0e-8
 
 /**
  * fysa120 nimiavaruus
@@ -44,6 +79,7 @@ namespace fysa120
      */
     double f1(double x, void* cparam)
     {
+        FYSA120_LASKURI("qags.f_evals");
         parametrit &par = *reinterpret_cast<parametrit *>(cparam);
         double l = par.l;
         double k = par.k;
@@ -60,6 +96,7 @@ namespace fysa120
      */
     double f2_real(double x, void* cparam)
     {
+        FYSA120_LASKURI("qags.f_evals");
         parametrit &par = *reinterpret_cast<parametrit *>(cparam);
         double l = par.l;
         double k = par.k;
@@ -76,6 +113,7 @@ namespace fysa120
      */
     double f2_img(double x, void* cparam)
     {
+        FYSA120_LASKURI("qags.f_evals");
         parametrit &par = *reinterpret_cast<parametrit *>(cparam);
         double l = par.l;
         double k = par.k;
@@ -96,7 +134,7 @@ namespace fysa120
         double alaraja = k;
         double ylaraja = l+1.0;
         double abs_virhe = 1.0e-8;
-        double suht_virhe = 1.0e-8;
+        double suht_virhe = SUHT_VIRHE;
         double vastaus;
         double virhe;
         
@@ -112,6 +150,9 @@ namespace fysa120
         
         gsl_integration_qags(&funktio, alaraja, ylaraja, abs_virhe, suht_virhe, 
                                      LIMIT_SIZE, work_ptr, &vastaus, &virhe);
+        FYSA120_LASKURI("qags.calls");
+        FYSA120_LASKURI_N("qags.subintervals", work_ptr->size);
+        FYSA120_HISTOGRAMMI("qags.subintervals_per_call", work_ptr->size);
         
         gsl_integration_workspace_free(work_ptr);
         std::complex<double> z(vastaus,0.0); 
@@ -132,7 +173,7 @@ namespace fysa120
         double alaraja = k;
         double ylaraja = k+1.0;
         double abs_virhe = 1.0e-8;
-        double suht_virhe = 1.0e-8;
+        double suht_virhe = SUHT_VIRHE;
         double vastaus;
         double virhe;
         
@@ -148,6 +189,9 @@ namespace fysa120
         
         gsl_integration_qags(&funktio, alaraja, ylaraja, abs_virhe, suht_virhe, 
                                      LIMIT_SIZE, work_ptr, &vastaus, &virhe);
+        FYSA120_LASKURI("qags.calls");
+        FYSA120_LASKURI_N("qags.subintervals", work_ptr->size);
+        FYSA120_HISTOGRAMMI("qags.subintervals_per_call", work_ptr->size);
         
         gsl_integration_workspace_free(work_ptr);
         
@@ -168,7 +212,7 @@ namespace fysa120
         double alaraja = k;
         double ylaraja = k+1.0;
         double abs_virhe = 1.0e-8;
-        double suht_virhe = 1.0e-8;
+        double suht_virhe = SUHT_VIRHE;
         double vastaus;
         double virhe;
         
@@ -184,6 +228,9 @@ namespace fysa120
         
         gsl_integration_qags(&funktio, alaraja, ylaraja, abs_virhe, suht_virhe, 
                                      LIMIT_SIZE, work_ptr, &vastaus, &virhe);
+        FYSA120_LASKURI("qags.calls");
+        FYSA120_LASKURI_N("qags.subintervals", work_ptr->size);
+        FYSA120_HISTOGRAMMI("qags.subintervals_per_call", work_ptr->size);
         
         gsl_integration_workspace_free(work_ptr);
         
@@ -204,61 +251,719 @@ namespace fysa120
         std::complex<double> z(real,img);
         return z;
     }
+    /**
+     * Integraalin f1 suljettu muoto benchmarkia varten.
+     * \int_{k}^{l+1}\frac{x^2}{x+c}dx = [x^2/2 - cx + c^2 ln(x+c)], c = k+l
+     * @param l Parametri l
+     * @param k Parametri k
+     * @return Integraalin arvo kompleksilukuna
+     */
+    std::complex<double> f1_suljettu(double l, double k)
+    {
+        double c = k+l;
+        auto F = [c](double x) { return 0.5*x*x - c*x + c*c*std::log(x+c); };
+        return std::complex<double>(F(l+1.0) - F(k), 0.0);
+    }
+
+
+    /**
+     * Muodostaa NxN kompleksimatriisin A: diagonaalilla f2(l,k), muualla f1(l,k).
+     * @param N Matriisin koko
+     * @param alkio Funktio, jolla lasketaan diagonaalin ulkopuoliset alkiot
+     * @return Matriisi A
+     */
+    arma::cx_mat muodosta_matriisi(arma::uword N,
+                                   const std::function<std::complex<double>(double,double)> &alkio = integroi_f1)
+    {
+        FYSA120_AJASTIN("matriisi.kokoaminen");
+        arma::cx_mat A(N,N, arma::fill::zeros);
+        for(arma::uword l = 0 ; l < A.n_cols ; ++l)
+        {
+            for(arma::uword k = 0 ; k < A.n_rows ; ++k)
+            {
+                if( k == l)
+                {
+                    A(k,l) = integroi_f2(l,k);
+                }
+                else
+                {
+                    A(k,l) = alkio(l,k);
+                }
+            }
+        }
+        return A;
+    }
+
+
+    /**
+     * Muodostaa NxN kompleksimatriisin A kuten muodosta_matriisi, mutta
+     * diagonaalin ulkopuoliset alkiot lasketaan Chebyshev-laatoista.
+     *
+     * f1(l,k) on sileä l:n ja k:n funktio, joten (l,k)-alue jaetaan laattoihin,
+     * joissa sitä approksimoidaan asteen 'aste' polynomilla (chebyshev_kokoa).
+     * Integroidaan vain laattojen näytepisteissä, tarkistuspisteissä ja
+     * laatoissa, joissa toleranssia ei saavuteta; muut alkiot lasketaan
+     * Clenshaw'n rekursiolla. Diagonaali f2(l,l) lasketaan aina tarkasti.
+     *
+     * Integraalien oma virhe on luokkaa SUHT_VIRHE, joten tiukempaa laatan
+     * toleranssia ei voi saavuttaa, ja tol nostetaan vähintään siihen.
+     *
+     * @param N Matriisin koko
+     * @param tol Suhteellinen toleranssi laattaa kohden (vähintään SUHT_VIRHE)
+     * @param t Tilastot (laatat, integraalien määrä)
+     * @param alkio Reaaliarvoinen funktio diagonaalin ulkopuolisille alkioille
+     * @param aste Chebyshev-polynomin aste kumpaankin suuntaan
+     * @return Matriisi A
+     */
+    arma::cx_mat muodosta_matriisi_cheb(arma::uword N, double tol, chebyshev_tilastot &t,
+                                        const std::function<double(double,double)> &alkio =
+                                            [](double l, double k) { return integroi_f1(l,k).real(); },
+                                        int aste = 16)
+    {
+        FYSA120_AJASTIN("matriisi.kokoaminen.cheb");
+        tol = std::max(tol, SUHT_VIRHE);
+        arma::cx_mat A(N,N, arma::fill::zeros);
+        // laatan sarake l, rivit k0..k0+n-1: A(k,l) = f1(l,k)
+        chebyshev_kokoa(N, N, alkio, [&A](std::size_t l, std::size_t k0, const double *z, std::size_t n) {
+            std::complex<double> *a = A.colptr(l) + k0;
+            for(std::size_t i = 0 ; i < n ; ++i) a[i] = z[i];
+        }, tol, aste, t);
+        for(arma::uword l = 0 ; l < N ; ++l)
+        {
+            A(l,l) = integroi_f2(l,l);
+        }
+        FYSA120_LASKURI_N("cheb.integrals", t.kutsut);
+        FYSA120_LASKURI_N("cheb.tiles", t.laatat);
+        return A;
+    }
+
+
+    /**
+     * Muodostaa matriisista harvan version pudottamalla pienet alkiot pois.
+     * Diagonaali säilytetään aina.
+     * @param A Tiheä matriisi
+     * @param kynnys Suhteellinen kynnys: alkio pudotetaan, jos |a| < kynnys*max|a|
+     * @return Harva matriisi
+     */
+    arma::sp_cx_mat harvenna(const arma::cx_mat &A, double kynnys)
+    {
+        FYSA120_AJASTIN("matriisi.harvennus");
+        const double raja = kynnys * arma::abs(A).max();
+        arma::uword nnz = 0;
+        for(arma::uword l = 0 ; l < A.n_cols ; ++l)
+        {
+            for(arma::uword k = 0 ; k < A.n_rows ; ++k)
+            {
+                if(k == l || std::abs(A(k,l)) >= raja) ++nnz;
+            }
+        }
+
+        // kerätään paikat ja arvot kerralla (batch insertion)
+        arma::umat paikat(2, nnz);
+        arma::cx_vec arvot(nnz);
+        arma::uword n = 0;
+        for(arma::uword l = 0 ; l < A.n_cols ; ++l)
+        {
+            for(arma::uword k = 0 ; k < A.n_rows ; ++k)
+            {
+                if(k == l || std::abs(A(k,l)) >= raja)
+                {
+                    paikat(0,n) = k;
+                    paikat(1,n) = l;
+                    arvot[n] = A(k,l);
+                    ++n;
+                }
+            }
+        }
+        return arma::sp_cx_mat(paikat, arvot, A.n_rows, A.n_cols, false, false);
+    }
+
+
+    /**
+     * Kokoaa harvan matriisin alkio kerrallaan ilman tiheää välivaihetta.
+     *
+     * Alkio pudotetaan kuten harvenna():ssa, jos |a| < kynnys*max|a|. Koska
+     * maksimi tunnetaan vasta lopussa, lisättäessä verrataan siihenastiseen
+     * maksimiin (joka ei ylitä lopullista), ja säilytetyt alkiot suodatetaan
+     * vielä lopullisella maksimilla. Diagonaali säilytetään aina.
+     */
+    class harva_kokoaja
+    {
+    public:
+        harva_kokoaja(arma::uword N, double kynnys) : N_(N), kynnys_(kynnys), suurin_(0.0) {}
+
+        void lisaa(arma::uword k, arma::uword l, std::complex<double> a)
+        {
+            const double r = std::abs(a);
+            suurin_ = std::max(suurin_, r);
+            if(k == l || r >= kynnys_ * suurin_)
+            {
+                alkiot_.push_back(alkio{k, l, a});
+            }
+        }
+
+        arma::sp_cx_mat valmis(void) const
+        {
+            const double raja = kynnys_ * suurin_;
+            arma::uword nnz = 0;
+            for(const auto &e : alkiot_)
+            {
+                if(e.k == e.l || std::abs(e.a) >= raja) ++nnz;
+            }
+            arma::umat paikat(2, nnz);
+            arma::cx_vec arvot(nnz);
+            arma::uword n = 0;
+            for(const auto &e : alkiot_)
+            {
+                if(e.k == e.l || std::abs(e.a) >= raja)
+                {
+                    paikat(0,n) = e.k;
+                    paikat(1,n) = e.l;
+                    arvot[n] = e.a;
+                    ++n;
+                }
+            }
+            // Chebyshev-laatat kirjoitetaan laatoittain, joten paikat lajitellaan
+            return arma::sp_cx_mat(paikat, arvot, N_, N_, true, false);
+        }
+
+    private:
+        struct alkio
+        {
+            arma::uword k;
+            arma::uword l;
+            std::complex<double> a;
+        };
+
+        arma::uword N_;
+        double kynnys_;
+        double suurin_;
+        std::vector<alkio> alkiot_;
+    };
+
+
+    /**
+     * Kirjoittaa harvan matriisin binääritiedostoon (binary_io.hpp) nollasta
+     * poikkeavien alkioiden taulukkona (nnz, 4) sarakkeittain: rivi, sarake,
+     * reaaliosa ja imaginääriosa. Indeksit ovat tarkkoja 2^53:een asti, ja
+     * muunna b2t tuottaa tiedostosta suoraan koordinaattimuotoisen tekstin.
+     * @return true jos kirjoitus epäonnistuu
+     */
+    bool kirjoita_harva_binaari(const std::string &nimi, const arma::sp_cx_mat &S)
+    {
+        const std::size_t nnz = S.n_nonzero;
+        std::vector<double> rivit(nnz);
+        std::vector<double> sarakkeet(nnz);
+        std::vector<double> re(nnz);
+        std::vector<double> im(nnz);
+        std::size_t n = 0;
+        for(auto it = S.begin() ; it != S.end() ; ++it, ++n)
+        {
+            const std::complex<double> z = *it;
+            rivit[n] = it.row();
+            sarakkeet[n] = it.col();
+            re[n] = z.real();
+            im[n] = z.imag();
+        }
+        const std::size_t tavut = nnz * sizeof(double);
+        return kirjoita_binaari(nimi, dtype::f64, {nnz, 4},
+                                {{rivit.data(), tavut}, {sarakkeet.data(), tavut}, {re.data(), tavut}, {im.data(), tavut}});
+    }
+
+
+    /**
+     * Muodostaa harvan version matriisista A suoraan (vrt. harvenna(muodosta_matriisi(N), kynnys)),
+     * jolloin N x N tiheää matriisia ei tarvita osaspektrin laskennassa.
+     * @param N Matriisin koko
+     * @param kynnys Suhteellinen kynnys kuten harvenna():ssa
+     * @param cheb Chebyshev-sijaismallin toleranssi (vähintään SUHT_VIRHE, vrt.
+     *             muodosta_matriisi_cheb), < 0 = jokainen alkio integroidaan
+     * @param t Chebyshev-tilastot
+     * @param alkio Funktio, jolla lasketaan diagonaalin ulkopuoliset alkiot
+     * @return Harva matriisi
+     */
+    arma::sp_cx_mat muodosta_harva(arma::uword N, double kynnys, double cheb, chebyshev_tilastot &t,
+                                   const std::function<std::complex<double>(double,double)> &alkio = integroi_f1)
+    {
+        FYSA120_AJASTIN("matriisi.kokoaminen.harva");
+        harva_kokoaja h(N, kynnys);
+        for(arma::uword l = 0 ; l < N ; ++l)
+        {
+            h.lisaa(l, l, integroi_f2(l,l));
+        }
+        if(cheb > 0.0)
+        {
+            auto f = [&alkio](double l, double k) { return alkio(l,k).real(); };
+            chebyshev_kokoa(N, N, f, [&h](std::size_t l, std::size_t k0, const double *z, std::size_t n) {
+                for(std::size_t i = 0 ; i < n ; ++i)
+                {
+                    if(k0 + i != l) h.lisaa(k0 + i, l, z[i]);
+                }
+            }, std::max(cheb, SUHT_VIRHE), 16, t);
+            FYSA120_LASKURI_N("cheb.integrals", t.kutsut);
+            FYSA120_LASKURI_N("cheb.tiles", t.laatat);
+        }
+        else
+        {
+            for(arma::uword l = 0 ; l < N ; ++l)
+            {
+                for(arma::uword k = 0 ; k < N ; ++k)
+                {
+                    if(k != l) h.lisaa(k, l, alkio(l,k));
+                }
+            }
+        }
+        return h.valmis();
+    }
+
+
+    /**
+     * Laskee k ominaisarvoa ja -vektoria implisiittisesti uudelleenkäynnistetyllä
+     * Arnoldi-menetelmällä (ARPACK, arma::eigs_gen).
+     * @param S Harva matriisi
+     * @param k Haettavien ominaisparien lukumäärä
+     * @param alue Haettava spektrin osa: "lm", "sm", "lr", "sr", "li" tai "si"
+     * @param eigval Löydetyt ominaisarvot
+     * @param eigvec Löydetyt ominaisvektorit
+     * @return true jos laskenta epäonnistuu
+     */
+    bool osaspektri(const arma::sp_cx_mat &S, arma::uword k, const std::string &alue,
+                    arma::cx_vec &eigval, arma::cx_mat &eigvec)
+    {
+        FYSA120_AJASTIN("eigs_gen");
+        // ARPACK vaatii k < N-1
+        if(k == 0 || k + 1 >= S.n_rows)
+        {
+            return true;
+        }
+        return !arma::eigs_gen(eigval, eigvec, S, k, alue.c_str());
+    }
+
+
+    /**
+     * Ominaisparien jäännökset ||Av - lambda v|| / |lambda|.
+     */
+    template<typename M>
+    arma::vec jaannokset(const M &A, const arma::cx_vec &eigval, const arma::cx_mat &eigvec)
+    {
+        arma::vec r(eigval.n_elem);
+        for(arma::uword i = 0 ; i < eigval.n_elem ; ++i)
+        {
+            arma::cx_vec v = eigvec.col(i);
+            arma::cx_vec Av = A * v;
+            r[i] = arma::norm(Av - eigval[i]*v) / std::max(std::abs(eigval[i]), 1.0e-300);
+        }
+        return r;
+    }
+
+
+    /**
+     * Komentoriviltä luettavat asetukset.
+     */
+    struct asetukset
+    {
+        arma::uword N = 5;          ///< matriisin koko
+        arma::uword k = 0;          ///< haettavien ominaisparien määrä, 0 = koko spektri
+        std::string alue = "lm";    ///< haettava spektrin osa eigs_gen:lle
+        double kynnys = -1.0;       ///< harvennuksen kynnys, < 0 = ei annettu (pakollinen -k:n kanssa)
+        double cheb = -1.0;         ///< Chebyshev-sijaismallin toleranssi, < 0 = jokainen alkio integroidaan
+        bool cheb_tarkistus = false;    ///< verrataan Chebyshev-matriisia tarkkaan (vaatii --cheb)
+        bool bench = false;         ///< ajetaan benchmark
+        bool binaari = false;       ///< tulokset binäärimuodossa (A.bin, eigval.bin, eigvec.bin)
+        bool hiljainen = false;     ///< ei tulosteta matriiseja ja vektoreita
+        arma::uword bench_full = 5000;  ///< suurin N, jolle ajetaan täysi eig_gen benchmarkissa
+        std::vector<arma::uword> bench_n = {500, 1000, 2000, 4000, 8000};
+    };
+
+
+    /**
+     * Tulostaa käyttöohjeen.
+     */
+    void kaytto(const char *nimi)
+    {
+        std::cout << "Käyttö: " << nimi << " [valinnat]\n"
+                  << "  -n N              matriisin koko (oletus 5)\n"
+                  << "  -k K              lasketaan vain K ominaisparia Arnoldi-menetelmällä harvasta\n"
+                  << "                    matriisista (ei tiheää A:ta eikä determinanttia), vaatii -t:n\n"
+                  << "  -w lm|sm|lr|sr|li|si  haettava spektrin osa (oletus lm)\n"
+                  << "  -t KYNNYS         harvennetaan matriisi: |a| < KYNNYS*max|a| pudotetaan\n"
+                  << "                    (-t 0 säilyttää kaikki N^2 alkiota harvassa muodossa)\n"
+                  << "  --cheb TOL        diagonaalin ulkopuoliset alkiot Chebyshev-laatoista toleranssilla TOL\n"
+                  << "                    (vähintään integroinnin toleranssi 1e-8)\n"
+                  << "  --cheb-verify     verrataan Chebyshev-matriisia tarkkaan: max|A_cheb - A|/max|A|\n"
+                  << "                    (integroi kaikki N^2 alkiota, pienille N:n arvoille)\n"
+                  << "  --binary          kirjoitetaan A.bin, eigval.bin ja eigvec.bin (binary_io.hpp);\n"
+                  << "                    -k:lla harva A kirjoitetaan A_harva.bin:iin (rivi, sarake, re, im)\n"
+                  << "  -q                ei tulosteta matriiseja ja vektoreita\n"
+                  << "  --bench           verrataan eigs_gen ja eig_gen aikaa ja muistia\n"
+                  << "  --bench-n N1,N2   benchmarkin matriisikoot (oletus 500,...,8000)\n"
+                  << "  --bench-full N    suurin koko, jolle ajetaan täysi eig_gen (oletus 5000)\n";
+    }
+
+
+    /**
+     * Lukee komentorivin valinnat.
+     * @return true jos valinnat ovat virheelliset
+     */
+    bool lue_asetukset(int argc, char *argv[], asetukset &a)
+    {
+        for(int i = 1 ; i < argc ; ++i)
+        {
+            std::string s = argv[i];
+            bool arvo = (i+1 < argc);
+            if(s == "-n" && arvo)               a.N = std::strtoul(argv[++i], nullptr, 10);
+            else if(s == "-k" && arvo)          a.k = std::strtoul(argv[++i], nullptr, 10);
+            else if(s == "-w" && arvo)          a.alue = argv[++i];
+            else if(s == "-t" && arvo)          a.kynnys = std::atof(argv[++i]);
+            else if(s == "--cheb" && arvo)      a.cheb = std::atof(argv[++i]);
+            else if(s == "--cheb-verify")       a.cheb_tarkistus = true;
+            else if(s == "--binary")            a.binaari = true;
+            else if(s == "-q")                  a.hiljainen = true;
+            else if(s == "--bench")             a.bench = true;
+            else if(s == "--bench-full" && arvo) a.bench_full = std::strtoul(argv[++i], nullptr, 10);
+            else if(s == "--bench-n" && arvo)
+            {
+                a.bench_n.clear();
+                std::stringstream ss(argv[++i]);
+                std::string n;
+                while(std::getline(ss, n, ','))
+                {
+                    a.bench_n.push_back(std::strtoul(n.c_str(), nullptr, 10));
+                }
+            }
+            else
+            {
+                return true;
+            }
+        }
+        static const std::set<std::string> alueet = {"lm", "sm", "lr", "sr", "li", "si"};
+        // ilman kynnystä harva matriisi veisi enemmän muistia kuin tiheä, joten
+        // osaspektrille kynnys on annettava tietoisesti (myös -t 0); benchmarkilla on oletus
+        const bool kynnys_puuttuu = a.k > 0 && a.kynnys < 0.0 && !a.bench;
+        const bool cheb_puuttuu = a.cheb_tarkistus && a.cheb <= 0.0;
+        return a.N == 0 || alueet.count(a.alue) == 0 || kynnys_puuttuu || cheb_puuttuu;
+    }
+
 
     /**
      * Tehdään pyydetyt laskutoimitukset
      */
-    void suorita_laskenta(void)
+    void suorita_laskenta(const asetukset &a)
     {
         std::complex<double> z;
         
-        // Luodaan 5x5 kompleksi matriisi
-        arma::cx_mat A(5,5, arma::fill::zeros);
+        // Luodaan NxN kompleksi matriisi ja lasketaan arvot. Osaspektriä (-k)
+        // varten kootaan vain harva matriisi, jolloin tiheää A:ta ei tarvita.
+        arma::cx_mat A;
+        arma::sp_cx_mat S;
+        chebyshev_tilastot t;
+        if(a.k > 0)
+        {
+            S = muodosta_harva(a.N, a.kynnys, a.cheb, t);
+            std::cout << "nnz = " << S.n_nonzero << " / " << a.N*a.N << std::endl;
+        }
+        else if(a.cheb > 0.0)
+        {
+            A = muodosta_matriisi_cheb(a.N, a.cheb, t);
+        }
+        else
+        {
+            A = muodosta_matriisi(a.N);
+        }
+        if(a.cheb > 0.0)
+        {
+            std::cout << "Chebyshev: " << t.laatat << " laattaa, " << t.kutsut << " integraalia "
+                      << "(N^2 = " << a.N*a.N << "), " << t.tarkat << " alkiota tarkasti, "
+                      << "suurin suhteellinen virhearvio " << t.suurin_arvio
+                      << " (heuristinen, ei yläraja)" << std::endl;
+        }
+        if(a.cheb_tarkistus)
+        {
+            // -k:lla tiheää Chebyshev-matriisia ei ole vielä koottu
+            arma::cx_mat C;
+            if(a.k > 0)
+            {
+                chebyshev_tilastot t2;
+                C = muodosta_matriisi_cheb(a.N, a.cheb, t2);
+            }
+            const arma::cx_mat &A_cheb = (a.k > 0) ? C : A;
+            const arma::cx_mat A_tarkka = muodosta_matriisi(a.N);
+            std::cout << "Chebyshev-tarkistus: max|A_cheb - A| / max|A| = "
+                      << arma::abs(A_cheb - A_tarkka).max() / arma::abs(A_tarkka).max() << std::endl;
+        }
 
-        // Lasketaan arvot ja talletetaan ne matriisiin
-        for(int k = 0 ; k < A.n_rows ; ++k)
+        // Tulostetaan matriisi ja talletetaan se A.mat (tai A.bin) tiedostoon.
+        // Harva matriisi talletetaan koordinaattimuodossa A.mat:iin tai A_harva.bin:iin.
+        if(a.k > 0)
         {
-            for(int l = 0 ; l < A.n_cols ; ++l)
+            if(!a.hiljainen)
             {
-                if( k == l)
+                S.print("A = ");
+            }
+            if(a.binaari)
+            {
+                if(kirjoita_harva_binaari("A_harva.bin", S))
                 {
-                    A(k,l) = integroi_f2(l,k);
+                    std::cerr << "A_harva.bin:n kirjoitus epäonnistui" << std::endl;
                 }
-                else
+            }
+            else
+            {
+                S.save("A.mat", arma::coord_ascii);
+            }
+        }
+        else
+        {
+            if(!a.hiljainen)
+            {
+                A.print("A = ");
+            }
+            if(a.binaari)
+            {
+                if(kirjoita_binaari("A.bin", A.memptr(), {A.n_rows, A.n_cols}))
                 {
-                    A(k,l) = integroi_f1(l,k);
+                    std::cerr << "A.bin:n kirjoitus epäonnistui" << std::endl;
                 }
             }
+            else
+            {
+                A.save("A.mat", arma::arma_ascii);
+            }
         }
-        // Tulostetaan matriisi ja talletetaan se A.mat tiedostoon
-        A.print("A = ");
-        A.save("A.mat", arma::arma_ascii);
         
         // Lasketaan ominaisarvot ja ominaisvektorit
         arma::cx_vec eigval;
         arma::cx_mat eigvec;
-        arma::eig_gen(eigval, eigvec, A);
-        std::cout << "eigval = \n" << eigval << std::endl;
-        std::cout << "eigvec = \n" << eigvec << std::endl;
+        if(a.k == 0)
+        {
+            FYSA120_AJASTIN("eig_gen");
+            arma::eig_gen(eigval, eigvec, A);
+        }
+        else if(osaspektri(S, a.k, a.alue, eigval, eigvec))
+        {
+            std::cerr << "eigs_gen epäonnistui (k = " << a.k << ", N = " << a.N << ")" << std::endl;
+            return;
+        }
+        if(a.binaari)
+        {
+            if(kirjoita_binaari("eigval.bin", eigval.memptr(), {eigval.n_elem}))
+            {
+                std::cerr << "eigval.bin:n kirjoitus epäonnistui" << std::endl;
+            }
+            if(kirjoita_binaari("eigvec.bin", eigvec.memptr(), {eigvec.n_rows, eigvec.n_cols}))
+            {
+                std::cerr << "eigvec.bin:n kirjoitus epäonnistui" << std::endl;
+            }
+        }
+        if(!a.hiljainen)
+        {
+            std::cout << "eigval = \n" << eigval << std::endl;
+            std::cout << "eigvec = \n" << eigvec << std::endl;
         
-        // Tarkistus
-        arma::cx_mat Q = eigvec;
-        arma::cx_mat Y = Q.i()*A*Q; 
-        std::cout << "(Q^-1AQ).diag = \n" << Y.diag() << std::endl;
+            // Tarkistus
+            if(a.k == 0)
+            {
+                arma::cx_mat Q = eigvec;
+                arma::cx_mat Y = Q.i()*A*Q; 
+                std::cout << "(Q^-1AQ).diag = \n" << Y.diag() << std::endl;
+            }
+            else
+            {
+                std::cout << "||Av-lv||/|l| = \n" << jaannokset(S, eigval, eigvec) << std::endl;
+            }
+        }
          
-        // Lasketaan determinatti
-        z = arma::det(A);
-        std::cout << "det A = " << z << std::endl;
+        // Lasketaan determinatti. Osaspektrin tilassa se jätetään pois, koska
+        // tiheä LU-hajotelma (O(N^3)) kumoaisi harvan laskennan hyödyn.
+        if(a.k == 0)
+        {
+            z = arma::det(A);
+            std::cout << "det A = " << z << std::endl;
+        }
+    }
+
+
+    /**
+     * Suorittaa f:n lapsiprosessissa ja palauttaa sen tulosteen ja suurimman
+     * muistinkäytön. Jokainen mittaus saa näin oman muistihuippunsa; oman
+     * prosessin ru_maxrss ei koskaan pienene, joten se näyttäisi jokaisella
+     * rivillä suurimman siihenastisen huipun.
+     * @param f Lapsessa suoritettava mittaus, palauttaa tulostettavan tekstin
+     * @param tuloste Lapsen tuloste
+     * @param rss_mb Lapsen suurin muistinkäyttö (max RSS) megatavuina
+     * @return true jos lapsiprosessi epäonnistuu
+     */
+    bool lapsessa(const std::function<std::string(void)> &f, std::string &tuloste, double &rss_mb)
+    {
+        int putki[2];
+        if(::pipe(putki) != 0)
+        {
+            return true;
+        }
+        std::cout.flush();
+        const pid_t pid = ::fork();
+        if(pid < 0)
+        {
+            ::close(putki[0]);
+            ::close(putki[1]);
+            return true;
+        }
+        if(pid == 0)
+        {
+            // _exit: ei puhdisteta vanhemmalta perittyjä puskureita eikä profiilia
+            ::close(putki[0]);
+            int paluu = 0;
+            try
+            {
+                const std::string r = f();
+                for(std::size_t i = 0 ; i < r.size() ; )
+                {
+                    const ssize_t n = ::write(putki[1], r.data() + i, r.size() - i);
+                    if(n <= 0)
+                    {
+                        paluu = 1;
+                        break;
+                    }
+                    i += n;
+                }
+            }
+            catch(...)
+            {
+                paluu = 1;
+            }
+            ::_exit(paluu);
+        }
+        ::close(putki[1]);
+        tuloste.clear();
+        char puskuri[4096];
+        ssize_t n;
+        while((n = ::read(putki[0], puskuri, sizeof(puskuri))) > 0)
+        {
+            tuloste.append(puskuri, n);
+        }
+        ::close(putki[0]);
+        int tila;
+        struct rusage r;
+        if(::wait4(pid, &tila, 0, &r) != pid)
+        {
+            return true;
+        }
+        rss_mb = r.ru_maxrss / 1024.0;    // Linuxissa kilotavuina
+        return !WIFEXITED(tila) || WEXITSTATUS(tila) != 0;
+    }
+
+
+    /**
+     * Verrataan osaspektrin (eigs_gen) ja koko spektrin (eig_gen) aikaa ja muistia.
+     * Diagonaalin ulkopuoliset alkiot lasketaan suljetulla muodolla, jotta
+     * suurten matriisien kokoaminen ei hallitse ajoaikaa.
+     *
+     * Jokainen menetelmä ja N ajetaan omassa lapsiprosessissaan, joka myös
+     * kokoaa matriisinsa: maxRSS on kyseisen tapauksen oma muistihuippu.
+     * Aika mittaa vain ominaisarvolaskennan. Harvennettu tapaus kootaan suoraan
+     * harvaksi (muodosta_harva), joten tiheää matriisia ei tarvita lainkaan;
+     * kynnyksettömässä tapauksessa tiheä matriisi kopioidaan harvaksi ennen
+     * ajanottoa, ja sen muistihuippuun kuuluvat sekä tiheä matriisi että kopio.
+     */
+    void suorita_benchmark(const asetukset &a)
+    {
+        typedef std::chrono::steady_clock kello;
+        const arma::uword k = (a.k == 0) ? 6 : a.k;
+        const double kynnys = (a.kynnys < 0.0) ? 1.0e-3 : a.kynnys;
+
+        std::cout << "# k = " << k << ", alue = " << a.alue << ", kynnys = " << kynnys << "\n"
+                  << "# N menetelmä nnz aika[s] muisti_arvio[MB] maxRSS[MB] max_jäännös" << std::endl;
+
+        const double mb = 1.0/(1024.0*1024.0);
+        for(arma::uword N : a.bench_n)
+        {
+            const double tihea_mb = N * N * sizeof(arma::cx_double) * mb;
+            // ARPACK:n Krylov-kanta: ncv = max(2k+1, 20) vektoria
+            const double krylov_mb = std::max<arma::uword>(2*k+1, 20) * N * sizeof(arma::cx_double) * mb;
+
+            std::vector<std::function<std::string(void)>> tapaukset;
+            for(int tila = 0 ; tila < 2 ; ++tila)
+            {
+                tapaukset.push_back([=, &a]() {
+                    arma::sp_cx_mat S;
+                    if(tila == 0)
+                    {
+                        S = harvenna(muodosta_matriisi(N, f1_suljettu), 0.0);
+                    }
+                    else
+                    {
+                        chebyshev_tilastot t;
+                        S = muodosta_harva(N, kynnys, -1.0, t, f1_suljettu);
+                    }
+                    arma::cx_vec eigval;
+                    arma::cx_mat eigvec;
+                    auto t0 = kello::now();
+                    bool virhe = osaspektri(S, k, a.alue, eigval, eigvec);
+                    double aika = std::chrono::duration<double>(kello::now() - t0).count();
+                    double harva_mb = S.n_nonzero * (sizeof(arma::cx_double) + sizeof(arma::uword)) * mb;
+                    std::ostringstream os;
+                    os << N << (tila == 0 ? " eigs_gen_tiheä " : " eigs_gen_harva ")
+                       << S.n_nonzero << " " << aika << " " << harva_mb + krylov_mb << " ";
+                    os << (virhe ? -1.0 : arma::max(jaannokset(S, eigval, eigvec)));
+                    return os.str();
+                });
+            }
+            if(N <= a.bench_full)
+            {
+                tapaukset.push_back([=]() {
+                    arma::cx_mat A = muodosta_matriisi(N, f1_suljettu);
+                    arma::cx_vec eigval;
+                    arma::cx_mat eigvec;
+                    auto t0 = kello::now();
+                    arma::eig_gen(eigval, eigvec, A);
+                    double aika = std::chrono::duration<double>(kello::now() - t0).count();
+                    // A, eigvec + LAPACK:n kopio A:sta
+                    std::ostringstream os;
+                    os << N << " eig_gen " << A.n_elem << " " << aika << " " << 3*tihea_mb << " ";
+                    os << arma::max(jaannokset(A, eigval, eigvec));
+                    return os.str();
+                });
+            }
+
+            for(const auto &f : tapaukset)
+            {
+                std::string rivi;
+                double rss;
+                if(lapsessa(f, rivi, rss))
+                {
+                    std::cout << N << " # mittaus epäonnistui (muisti loppui?)" << std::endl;
+                    continue;
+                }
+                // maxRSS lisätään toiseksi viimeiseksi sarakkeeksi
+                const std::size_t v = rivi.rfind(' ');
+                std::cout << rivi.substr(0, v) << " " << rss << rivi.substr(v) << std::endl;
+            }
+        }
     }
 }
 
 
+#ifndef FYSA120_NO_MAIN
 /**
  * Pääohjelma suorittamista varten
  */
-int main(void)
+int main(int argc, char *argv[])
 {   
-    fysa120::suorita_laskenta();
+    FYSA120_PROFIILI("prj");
+    fysa120::asetukset a;
+    if(fysa120::lue_asetukset(argc, argv, a))
+    {
+        fysa120::kaytto(argv[0]);
+        return 1;
+    }
+    if(a.bench)
+    {
+        fysa120::suorita_benchmark(a);
+    }
+    else
+    {
+        fysa120::suorita_laskenta(a);
+    }
     return 0;
 }
-
+#endif